@@ -0,0 +1,178 @@
+//
+//  benchmark.cpp
+//  n-body-cpp
+//
+//  Created by Jacob MacKenzie-Websdale on 19/10/2026.
+//
+
+#include "benchmark.hpp"
+#include "fmm.hpp"
+#include "force.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+const std::array<uint32_t, 5> BENCHMARK_WORKGROUP_SIZES = {1, 16, 32, 64, 128};
+
+const size_t FMM_BENCHMARK_PARTICLES = 20000;
+const uint32_t FMM_BENCHMARK_STEPS = 3;
+
+// Half-widths of the boxes the FMM bodies are scattered in. In the dense one
+// most pairs fall inside MIN_INTERACTION_DISTANCE.
+const float FMM_SPARSE_HALF_WIDTH = 50;
+const float FMM_DENSE_HALF_WIDTH = 0.1;
+
+// One body in FMM_ERROR_STRIDE is checked against a direct sum, which the FMM
+// must match to this relative L2 error
+const size_t FMM_ERROR_STRIDE = 20;
+const double FMM_ERROR_TOLERANCE = 0.001;
+
+const float BENCHMARK_DT = 0.1;
+
+static bool runCompute(const std::array<Particle, MAX_PARTICLE_COUNT>& particles, uint32_t steps, ReductionMode mode, uint32_t workgroupSize, double& millisecondsPerStep, int32_t& fractionBits, std::array<Particle, MAX_PARTICLE_COUNT>& result) {
+    ComputeShaderInterface csi;
+    if (csi.setup(DisplayMode::None, mode, workgroupSize) != EXIT_SUCCESS) {
+        return false;
+    }
+    csi.mapMemory();
+    csi.copyToBuffer(particles, BENCHMARK_DT);
+    csi.waitIdle();
+    fractionBits = csi.getFixedPointFractionBits();
+
+    // Only the last step is read back, and its wait is part of the timing
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < steps; i++) {
+        csi.dispatchShader(i + 1 == steps);
+    }
+    void* data;
+    csi.retrieveResult(&data);
+    auto end = std::chrono::steady_clock::now();
+
+    millisecondsPerStep = std::chrono::duration<double, std::milli>(end - start).count() / steps;
+    memcpy(result.data(), data, sizeof(OutputData));
+    csi.retrieveResultCleanup();
+
+    csi.cleanup();
+    return true;
+}
+
+static std::vector<Particle> runFMM(const std::vector<Particle>& particles, uint32_t steps, unsigned threadCount, double& millisecondsPerStep) {
+    FMMInterface fmm(4, 64, 0.5, threadCount);
+    fmm.setup();
+    fmm.copyToBuffer(particles, BENCHMARK_DT);
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < steps; i++) {
+        fmm.dispatchShader();
+    }
+    auto end = std::chrono::steady_clock::now();
+    millisecondsPerStep = std::chrono::duration<double, std::milli>(end - start).count() / steps;
+
+    void* data;
+    fmm.retrieveResult(&data);
+    std::vector<Particle> result(static_cast<Particle*>(data), static_cast<Particle*>(data) + particles.size());
+    fmm.cleanup();
+    return result;
+}
+
+// Relative L2 error of the accelerations one step from `bodies` (at rest)
+// produced, against a direct sum with the same pair law and cutoff
+static double directSumError(const std::vector<Particle>& bodies, const std::vector<Particle>& result) {
+    double error = 0, norm = 0;
+    for (size_t i = 0; i < bodies.size(); i += FMM_ERROR_STRIDE) {
+        float force[3] = {0, 0, 0};
+        for (size_t j = 0; j < bodies.size(); j++) {
+            if (j == i) continue;
+            accumulatePairwiseForce(NewtonianLaw{}, bodies[i], bodies[j], force);
+        }
+
+        const float velocity[3] = {result[i].vx, result[i].vy, result[i].vz};
+        for (int d = 0; d < 3; d++) {
+            double expected = force[d] / bodies[i].mass;
+            double actual = velocity[d] / BENCHMARK_DT;
+            error += (actual - expected) * (actual - expected);
+            norm += expected * expected;
+        }
+    }
+    return norm > 0 ? std::sqrt(error / norm) : 0;
+}
+
+uint8_t runReductionBenchmark(const std::array<Particle, MAX_PARTICLE_COUNT>& particles, uint32_t steps) {
+    if (steps == 0) {
+        std::cerr << "benchmark needs at least one step" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    bool deterministicAgrees = true;
+    std::cout << std::fixed << std::setprecision(4);
+    std::cout << "mode           workgroup  ms/step  overhead  fraction bits  matches first" << std::endl;
+
+    std::array<double, BENCHMARK_WORKGROUP_SIZES.size()> fastTimes = {};
+    for (ReductionMode mode : {ReductionMode::Fast, ReductionMode::Deterministic}) {
+        bool deterministic = mode == ReductionMode::Deterministic;
+
+        std::array<Particle, MAX_PARTICLE_COUNT> reference;
+        bool haveReference = false;
+        for (size_t i = 0; i < BENCHMARK_WORKGROUP_SIZES.size(); i++) {
+            double milliseconds = 0;
+            int32_t fractionBits = 0;
+            std::array<Particle, MAX_PARTICLE_COUNT> result;
+            if (!runCompute(particles, steps, mode, BENCHMARK_WORKGROUP_SIZES[i], milliseconds, fractionBits, result)) {
+                std::cerr << "skipping workgroup size " << BENCHMARK_WORKGROUP_SIZES[i] << std::endl;
+                continue;
+            }
+
+            if (!haveReference) {
+                reference = result;
+                haveReference = true;
+            }
+            bool matches = memcmp(result.data(), reference.data(), sizeof(OutputData)) == 0;
+            deterministicAgrees &= !deterministic || matches;
+
+            if (!deterministic) {
+                fastTimes[i] = milliseconds;
+            }
+            std::cout << (deterministic ? "deterministic  " : "fast           ") << std::setw(9) << BENCHMARK_WORKGROUP_SIZES[i] << "  " << std::setw(7) << milliseconds << "  ";
+            if (deterministic && fastTimes[i] > 0) {
+                std::cout << std::setw(7) << (milliseconds / fastTimes[i] - 1) * 100 << "%  ";
+            } else {
+                std::cout << "       -  ";
+            }
+            // The fixed-point quantum is 2^-fractionBits
+            if (deterministic) {
+                std::cout << std::setw(13) << fractionBits << "  ";
+            } else {
+                std::cout << "            -  ";
+            }
+            std::cout << (matches ? "yes" : "no") << std::endl;
+        }
+    }
+
+    // The FMM engine has every sum owned by a single task, so the thread
+    // count must not change a single bit. Its far field must also agree with
+    // a direct sum, including where bodies crowd inside the cutoff.
+    unsigned threadCount = std::max(2u, std::thread::hardware_concurrency());
+    bool fmmAgrees = true;
+    for (float halfWidth : {FMM_SPARSE_HALF_WIDTH, FMM_DENSE_HALF_WIDTH}) {
+        std::mt19937 generator(0);
+        std::uniform_real_distribution<float> position(-halfWidth, halfWidth);
+        std::vector<Particle> bodies(FMM_BENCHMARK_PARTICLES);
+        for (auto& body : bodies) {
+            body = {position(generator), position(generator), position(generator), 0, 0, 0, 10000000000.0f};
+        }
+
+        double serialTime = 0, parallelTime = 0, stepTime = 0;
+        std::vector<Particle> serial = runFMM(bodies, FMM_BENCHMARK_STEPS, 1, serialTime);
+        std::vector<Particle> parallel = runFMM(bodies, FMM_BENCHMARK_STEPS, threadCount, parallelTime);
+        bool identical = memcmp(serial.data(), parallel.data(), serial.size() * sizeof(Particle)) == 0;
+        double error = directSumError(bodies, runFMM(bodies, 1, threadCount, stepTime));
+        fmmAgrees &= identical && error < FMM_ERROR_TOLERANCE;
+
+        std::cout << "fmm, " << FMM_BENCHMARK_PARTICLES << " bodies " << 2 * halfWidth << " wide: " << serialTime << " ms/step on 1 thread, " << parallelTime << " ms/step on " << threadCount << ", " << (identical ? "identical" : "DIFFERENT") << ", error vs direct sum " << std::scientific << error << std::fixed << std::endl;
+    }
+
+    return deterministicAgrees && fmmAgrees ? EXIT_SUCCESS : EXIT_FAILURE;
+}
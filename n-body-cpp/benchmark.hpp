@@ -0,0 +1,22 @@
+//
+//  benchmark.hpp
+//  n-body-cpp
+//
+//  Created by Jacob MacKenzie-Websdale on 19/10/2026.
+//
+
+#ifndef benchmark_hpp
+#define benchmark_hpp
+
+#include <stdio.h>
+#include "compute.hpp"
+
+// Times every ReductionMode over a range of workgroup sizes, `steps` steps
+// each from `particles`, and reports which runs agree bit for bit and the
+// fixed-point fraction bits the deterministic runs derived. Also
+// checks that the FMM engine gives the same bits on one thread as on all of
+// them, and that it matches a direct sum on a sparse and a dense layout.
+// Fails if a deterministic run disagrees or the FMM misses either check.
+uint8_t runReductionBenchmark(const std::array<Particle, MAX_PARTICLE_COUNT>& particles, uint32_t steps);
+
+#endif /* benchmark_hpp */
@@ -0,0 +1,321 @@
+//
+//  checkpoint.cpp
+//  n-body-cpp
+//
+//  Created by Jacob MacKenzie-Websdale on 19/10/2026.
+//
+
+#include "checkpoint.hpp"
+#include "compression.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+const char CHECKPOINT_MAGIC[4] = {'N', 'B', 'C', 'P'};
+const uint32_t CHECKPOINT_VERSION = 1;
+const std::string CHECKPOINT_EXTENSION = ".nbcp";
+
+const size_t PARTICLE_FIELDS = sizeof(Particle) / sizeof(float);
+
+// Like fields of neighbouring particles share sign and exponent bytes, so
+// grouping them first makes the shuffled planes far more repetitive
+static std::vector<uint8_t> toFieldMajor(const std::array<Particle, MAX_PARTICLE_COUNT>& particles) {
+    const float* values = reinterpret_cast<const float*>(particles.data());
+    std::vector<uint8_t> out(sizeof(Particle) * MAX_PARTICLE_COUNT);
+    for (size_t field = 0; field < PARTICLE_FIELDS; field++) {
+        for (size_t i = 0; i < MAX_PARTICLE_COUNT; i++) {
+            memcpy(&out[(field * MAX_PARTICLE_COUNT + i) * sizeof(float)], &values[i * PARTICLE_FIELDS + field], sizeof(float));
+        }
+    }
+    return out;
+}
+
+static void fromFieldMajor(const std::vector<uint8_t>& data, std::array<Particle, MAX_PARTICLE_COUNT>& particles) {
+    float* values = reinterpret_cast<float*>(particles.data());
+    for (size_t field = 0; field < PARTICLE_FIELDS; field++) {
+        for (size_t i = 0; i < MAX_PARTICLE_COUNT; i++) {
+            memcpy(&values[i * PARTICLE_FIELDS + field], &data[(field * MAX_PARTICLE_COUNT + i) * sizeof(float)], sizeof(float));
+        }
+    }
+}
+
+Checkpointer::Checkpointer(ComputeShaderInterface& compute, const std::string& prefix, uint64_t interval, uint32_t keyInterval)
+    : compute(compute), prefix(prefix), interval(interval), keyInterval(std::max(1u, keyInterval)) {
+}
+
+uint8_t Checkpointer::setup() {
+    if (interval == 0) {
+        std::cerr << "checkpoint interval must be at least one step" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Files left by an earlier run, including the one a restart resumed from
+    // and any newer damaged ones, count as the chain the next key ends. They
+    // stay as its fallback and are rotated out with the key after that.
+    chain = listSteps(prefix);
+    previousChain.clear();
+
+    writer = std::thread(&Checkpointer::writerLoop, this);
+    std::cout << "Checkpointing to " << prefix << "-*" << CHECKPOINT_EXTENSION << " every " << interval << " steps" << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+void Checkpointer::step() {
+    bool snapshot = (compute.getStepCount() + 1) % interval == 0;
+    compute.dispatchShader(snapshot);
+
+    // A snapshot still pending from the last interval is superseded
+    if (snapshot) {
+        pending = compute.latestSnapshot();
+        hasPending = true;
+    }
+    if (hasPending) {
+        capture(false);
+    }
+}
+
+void Checkpointer::capture(bool wait) {
+    const void* data = compute.pollSnapshot(pending);
+    if (data == nullptr && wait) {
+        compute.waitIdle();
+        data = compute.pollSnapshot(pending);
+    }
+    if (data == nullptr) {
+        return;
+    }
+    hasPending = false;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (wait) {
+        drained.wait(lock, [this] { return !slotBusy[0] || !slotBusy[1]; });
+    }
+
+    uint32_t slot = slotBusy[0] ? 1 : 0;
+    if (slotBusy[slot]) {
+        std::cerr << "checkpoint writer is behind, skipping step " << pending.step << std::endl;
+        return;
+    }
+    slotBusy[slot] = true;
+    lock.unlock();
+
+    // The readback buffer is only ours until the next snapshot is queued
+    memcpy(slots[slot].particles.data(), data, sizeof(OutputData));
+    slots[slot].step = pending.step;
+    slots[slot].dt = compute.getTimestep();
+
+    lock.lock();
+    queued.push_back(slot);
+    lock.unlock();
+    wake.notify_one();
+}
+
+void Checkpointer::flush() {
+    if (hasPending) {
+        capture(true);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    drained.wait(lock, [this] { return queued.empty() && !slotBusy[0] && !slotBusy[1]; });
+}
+
+void Checkpointer::writerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this] { return stopping || !queued.empty(); });
+        if (queued.empty()) {
+            return;
+        }
+
+        uint32_t slot = queued.front();
+        queued.pop_front();
+        lock.unlock();
+
+        write(slots[slot]);
+
+        lock.lock();
+        slotBusy[slot] = false;
+        drained.notify_all();
+    }
+}
+
+void Checkpointer::write(const Slot& slot) {
+    std::vector<uint8_t> raw = toFieldMajor(slot.particles);
+
+    bool key = previous.empty() || sinceKey >= keyInterval;
+    std::vector<uint8_t> coded = raw;
+    if (!key) {
+        for (size_t i = 0; i < coded.size(); i++) {
+            coded[i] ^= previous[i];
+        }
+    }
+
+    std::vector<uint8_t> shuffled = shuffleBytes(coded.data(), coded.size(), sizeof(float));
+    std::vector<uint8_t> compressed = lz4Compress(shuffled.data(), shuffled.size());
+
+    CheckpointHeader header{};
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.step = slot.step;
+    header.baseStep = key ? slot.step : previousStep;
+    header.dt = slot.dt;
+    header.integrator = INTEGRATOR_SEMI_IMPLICIT_EULER;
+    header.particleCount = MAX_PARTICLE_COUNT;
+    header.rawSize = (uint32_t) raw.size();
+    header.compressedSize = (uint32_t) compressed.size();
+    header.checksum = crc32(raw.data(), raw.size());
+
+    // Written aside and renamed into place, so a crash mid-write never
+    // leaves a truncated checkpoint under the real name
+    std::string target = path(prefix, slot.step);
+    std::string temporary = target + ".tmp";
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+    file.close();
+
+    std::error_code error;
+    if (file.fail()) {
+        std::cerr << "failed to write checkpoint " << temporary << std::endl;
+    } else {
+        std::filesystem::rename(temporary, target, error);
+        if (error) {
+            std::cerr << "failed to move checkpoint into place: " << error.message() << std::endl;
+        }
+    }
+    if (file.fail() || error) {
+        // The next checkpoint must not depend on this one
+        std::filesystem::remove(temporary, error);
+        previous.clear();
+        return;
+    }
+
+    // A file an earlier run left under this name has just been replaced
+    std::erase(chain, slot.step);
+    std::erase(previousChain, slot.step);
+
+    // Keep the chain that just ended as a fallback, drop the one before it
+    if (key) {
+        removeChain(previousChain);
+        previousChain = std::move(chain);
+        chain.clear();
+        sinceKey = 0;
+    }
+    chain.push_back(slot.step);
+    sinceKey++;
+    previous = std::move(raw);
+    previousStep = slot.step;
+}
+
+void Checkpointer::removeChain(const std::vector<uint64_t>& steps) {
+    std::error_code error;
+    for (uint64_t step : steps) {
+        std::filesystem::remove(path(prefix, step), error);
+    }
+}
+
+std::string Checkpointer::path(const std::string& prefix, uint64_t step) {
+    return prefix + "-" + std::to_string(step) + CHECKPOINT_EXTENSION;
+}
+
+std::vector<uint8_t> Checkpointer::load(const std::string& prefix, uint64_t step, CheckpointHeader& header) {
+    std::ifstream file(path(prefix, step), std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("cannot open " + path(prefix, step));
+    }
+
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 || header.version != CHECKPOINT_VERSION) {
+        throw std::runtime_error("not a checkpoint file");
+    }
+    if (header.step != step || header.baseStep > step) {
+        throw std::runtime_error("checkpoint header does not match its file name");
+    }
+    if (header.particleCount != MAX_PARTICLE_COUNT || header.rawSize != sizeof(Particle) * MAX_PARTICLE_COUNT) {
+        throw std::runtime_error("checkpoint holds " + std::to_string(header.particleCount) + " particles, expected " + std::to_string(MAX_PARTICLE_COUNT));
+    }
+    if (header.integrator != INTEGRATOR_SEMI_IMPLICIT_EULER) {
+        throw std::runtime_error("checkpoint was written by an unknown integrator");
+    }
+
+    std::vector<uint8_t> compressed(header.compressedSize);
+    file.read(reinterpret_cast<char*>(compressed.data()), compressed.size());
+    if (!file) {
+        throw std::runtime_error("checkpoint is truncated");
+    }
+
+    std::vector<uint8_t> shuffled = lz4Decompress(compressed.data(), compressed.size(), header.rawSize);
+    std::vector<uint8_t> raw = unshuffleBytes(shuffled.data(), shuffled.size(), sizeof(float));
+
+    if (header.baseStep != step) {
+        CheckpointHeader baseHeader;
+        std::vector<uint8_t> base = load(prefix, header.baseStep, baseHeader);
+        for (size_t i = 0; i < raw.size(); i++) {
+            raw[i] ^= base[i];
+        }
+    }
+
+    if (crc32(raw.data(), raw.size()) != header.checksum) {
+        throw std::runtime_error("checkpoint checksum mismatch");
+    }
+
+    return raw;
+}
+
+std::vector<uint64_t> Checkpointer::listSteps(const std::string& prefix) {
+    std::filesystem::path base(prefix);
+    std::filesystem::path directory = base.has_parent_path() ? base.parent_path() : std::filesystem::path(".");
+    std::string stem = base.filename().string() + "-";
+
+    // Collect <prefix>-<step>.nbcp, ignoring partially written .tmp files
+    std::vector<uint64_t> steps;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() <= stem.size() + CHECKPOINT_EXTENSION.size() || name.compare(0, stem.size(), stem) != 0 || name.compare(name.size() - CHECKPOINT_EXTENSION.size(), CHECKPOINT_EXTENSION.size(), CHECKPOINT_EXTENSION) != 0) {
+            continue;
+        }
+
+        std::string digits = name.substr(stem.size(), name.size() - stem.size() - CHECKPOINT_EXTENSION.size());
+        if (std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            steps.push_back(std::stoull(digits));
+        }
+    }
+    std::sort(steps.rbegin(), steps.rend());
+    return steps;
+}
+
+uint8_t Checkpointer::restore(ComputeShaderInterface& compute, const std::string& prefix) {
+    std::vector<uint64_t> steps = listSteps(prefix);
+    for (uint64_t step : steps) {
+        try {
+            CheckpointHeader header;
+            std::vector<uint8_t> raw = load(prefix, step, header);
+
+            std::array<Particle, MAX_PARTICLE_COUNT> particles;
+            fromFieldMajor(raw, particles);
+            compute.restoreState(particles, header.dt, header.step);
+
+            std::cout << "Restored step " << header.step << " from " << path(prefix, step) << std::endl;
+            return EXIT_SUCCESS;
+        } catch (const std::exception& exception) {
+            std::cerr << "skipping checkpoint " << path(prefix, step) << ": " << exception.what() << std::endl;
+        }
+    }
+
+    std::cerr << "no usable checkpoint for " << prefix << std::endl;
+    return EXIT_FAILURE;
+}
+
+void Checkpointer::cleanup() {
+    flush();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    writer.join();
+}
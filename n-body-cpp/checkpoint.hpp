@@ -0,0 +1,117 @@
+//
+//  checkpoint.hpp
+//  n-body-cpp
+//
+//  Created by Jacob MacKenzie-Websdale on 19/10/2026.
+//
+
+#ifndef checkpoint_hpp
+#define checkpoint_hpp
+
+#include <stdio.h>
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "compute.hpp"
+
+// shader.comp's update: velocity first, then position from the new velocity.
+// It carries no state beyond the particles themselves.
+const uint32_t INTEGRATOR_SEMI_IMPLICIT_EULER = 1;
+
+// On-disk layout, little-endian, followed by `compressedSize` bytes of
+// payload. The payload is the particle floats field by field (every x, then
+// every y, ...), XORed with the checkpoint at `baseStep` unless that is this
+// one, byte-shuffled and LZ4-coded.
+struct CheckpointHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t step;
+    uint64_t baseStep;
+    float dt;
+    uint32_t integrator;
+    uint32_t particleCount;
+    uint32_t rawSize;
+    uint32_t compressedSize;
+
+    // CRC-32 of the decoded particle data
+    uint32_t checksum;
+};
+
+// Periodic checkpoints of a ComputeShaderInterface run, written to
+// `<prefix>-<step>.nbcp`. Snapshots come off the transfer queue readbacks and
+// are handed to a writer thread through two host slots, so the compute loop
+// never waits on compression or disk; if both slots are still busy the
+// checkpoint is skipped instead. Every `keyInterval`-th checkpoint is stored
+// whole and the ones in between as deltas against their predecessor.
+class Checkpointer {
+    struct Slot {
+        std::array<Particle, MAX_PARTICLE_COUNT> particles;
+        uint64_t step;
+        float dt;
+    };
+
+    ComputeShaderInterface& compute;
+    std::string prefix;
+    uint64_t interval;
+    uint32_t keyInterval;
+
+    // Snapshot requested but not yet copied out of its readback buffer
+    bool hasPending = false;
+    SnapshotHandle pending;
+
+    // Shared with the writer thread
+    std::array<Slot, 2> slots;
+    std::array<bool, 2> slotBusy = {};
+    std::deque<uint32_t> queued;
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable drained;
+    std::thread writer;
+
+    // Writer thread only. `previous` is the field-major data of the last
+    // checkpoint written; chains list the steps since (and including) a key.
+    std::vector<uint8_t> previous;
+    uint64_t previousStep = 0;
+    uint32_t sinceKey = 0;
+    std::vector<uint64_t> chain;
+    std::vector<uint64_t> previousChain;
+
+public:
+    Checkpointer(ComputeShaderInterface& compute, const std::string& prefix, uint64_t interval, uint32_t keyInterval = 8);
+
+    uint8_t setup();
+
+    // Queues one step on `compute`, with a snapshot every `interval` steps,
+    // and passes finished snapshots on to the writer. Call in place of
+    // compute.dispatchShader().
+    void step();
+
+    // Blocks until every requested checkpoint is on disk
+    void flush();
+
+    // Loads the newest readable checkpoint under `prefix` into `compute`'s
+    // device buffers, falling back to older ones if it is damaged.
+    static uint8_t restore(ComputeShaderInterface& compute, const std::string& prefix);
+
+    // Clean-up
+    void cleanup();
+
+private:
+    void capture(bool wait);
+    void writerLoop();
+    void write(const Slot& slot);
+    void removeChain(const std::vector<uint64_t>& steps);
+
+    static std::string path(const std::string& prefix, uint64_t step);
+
+    // Steps of every <prefix>-<step>.nbcp on disk, newest first
+    static std::vector<uint64_t> listSteps(const std::string& prefix);
+    static std::vector<uint8_t> load(const std::string& prefix, uint64_t step, CheckpointHeader& header);
+};
+
+#endif /* checkpoint_hpp */
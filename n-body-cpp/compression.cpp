@@ -0,0 +1,190 @@
+//
+//  compression.cpp
+//  n-body-cpp
+//
+//  Created by Jacob MacKenzie-Websdale on 19/10/2026.
+//
+
+#include "compression.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// LZ4 block constraints: matches are at least 4 bytes, reach back at most
+// 64 KiB, and the last 5 bytes (and the last match start 12 bytes before the
+// end) are always literals.
+const size_t MIN_MATCH = 4;
+const size_t MAX_OFFSET = 65535;
+const size_t LAST_LITERALS = 5;
+const size_t MATCH_SEARCH_LIMIT = 12;
+const unsigned HASH_BITS = 16;
+
+uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc) {
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+std::vector<uint8_t> shuffleBytes(const uint8_t* data, size_t length, size_t elementSize) {
+    std::vector<uint8_t> out(length);
+    size_t count = length / elementSize;
+    for (size_t i = 0; i < count; i++) {
+        for (size_t byte = 0; byte < elementSize; byte++) {
+            out[byte * count + i] = data[i * elementSize + byte];
+        }
+    }
+
+    // A trailing partial element is left as is
+    memcpy(out.data() + count * elementSize, data + count * elementSize, length - count * elementSize);
+    return out;
+}
+
+std::vector<uint8_t> unshuffleBytes(const uint8_t* data, size_t length, size_t elementSize) {
+    std::vector<uint8_t> out(length);
+    size_t count = length / elementSize;
+    for (size_t i = 0; i < count; i++) {
+        for (size_t byte = 0; byte < elementSize; byte++) {
+            out[i * elementSize + byte] = data[byte * count + i];
+        }
+    }
+
+    memcpy(out.data() + count * elementSize, data + count * elementSize, length - count * elementSize);
+    return out;
+}
+
+static uint32_t read32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t hashSequence(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Lengths of 15 and over spill into extra bytes of 255 plus a remainder
+static void appendLength(std::vector<uint8_t>& out, size_t length) {
+    for (; length >= 255; length -= 255) {
+        out.push_back(255);
+    }
+    out.push_back((uint8_t) length);
+}
+
+static void appendSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalLength, size_t offset, size_t matchLength) {
+    size_t matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+    out.push_back((uint8_t) ((std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(matchCode, 15)));
+    if (literalLength >= 15) {
+        appendLength(out, literalLength - 15);
+    }
+    out.insert(out.end(), literals, literals + literalLength);
+
+    // The final sequence carries literals only
+    if (matchLength == 0) {
+        return;
+    }
+    out.push_back(offset & 0xFF);
+    out.push_back(offset >> 8);
+    if (matchCode >= 15) {
+        appendLength(out, matchCode - 15);
+    }
+}
+
+std::vector<uint8_t> lz4Compress(const uint8_t* data, size_t length) {
+    std::vector<uint8_t> out;
+    out.reserve(length + length / 255 + 16);
+
+    size_t anchor = 0;
+    if (length > MATCH_SEARCH_LIMIT) {
+        // Positions are stored plus one so that zero means empty
+        std::vector<uint32_t> table(1u << HASH_BITS, 0);
+        size_t matchEnd = length - LAST_LITERALS;
+
+        for (size_t position = 0; position < length - MATCH_SEARCH_LIMIT; ) {
+            uint32_t sequence = read32(data + position);
+            uint32_t& slot = table[hashSequence(sequence)];
+            size_t candidate = slot;
+            slot = (uint32_t) position + 1;
+
+            if (candidate == 0 || position - (candidate - 1) > MAX_OFFSET || read32(data + candidate - 1) != sequence) {
+                position++;
+                continue;
+            }
+            size_t reference = candidate - 1;
+
+            size_t matchLength = MIN_MATCH;
+            while (position + matchLength < matchEnd && data[reference + matchLength] == data[position + matchLength]) {
+                matchLength++;
+            }
+
+            appendSequence(out, data + anchor, position - anchor, position - reference, matchLength);
+            position += matchLength;
+            anchor = position;
+        }
+    }
+
+    appendSequence(out, data + anchor, length - anchor, 0, 0);
+    return out;
+}
+
+static size_t readLength(const uint8_t* data, size_t length, size_t& position, size_t base) {
+    if (base < 15) {
+        return base;
+    }
+    uint8_t byte;
+    do {
+        if (position >= length) {
+            throw std::runtime_error("truncated LZ4 block!");
+        }
+        byte = data[position++];
+        base += byte;
+    } while (byte == 255);
+    return base;
+}
+
+std::vector<uint8_t> lz4Decompress(const uint8_t* data, size_t length, size_t decompressedLength) {
+    std::vector<uint8_t> out;
+    out.reserve(decompressedLength);
+
+    size_t position = 0;
+    while (position < length) {
+        uint8_t token = data[position++];
+
+        size_t literalLength = readLength(data, length, position, token >> 4);
+        if (literalLength > length - position || literalLength > decompressedLength - out.size()) {
+            throw std::runtime_error("LZ4 literals run past the end of the block!");
+        }
+        out.insert(out.end(), data + position, data + position + literalLength);
+        position += literalLength;
+
+        if (position == length) {
+            break;
+        }
+        if (length - position < 2) {
+            throw std::runtime_error("truncated LZ4 block!");
+        }
+        size_t offset = data[position] | (data[position + 1] << 8);
+        position += 2;
+        size_t matchLength = readLength(data, length, position, token & 0x0F) + MIN_MATCH;
+
+        if (offset == 0 || offset > out.size() || matchLength > decompressedLength - out.size()) {
+            throw std::runtime_error("invalid LZ4 match!");
+        }
+
+        // Matches may overlap the bytes they produce, so copy one at a time
+        size_t source = out.size() - offset;
+        for (size_t i = 0; i < matchLength; i++) {
+            uint8_t byte = out[source + i];
+            out.push_back(byte);
+        }
+    }
+
+    if (out.size() != decompressedLength) {
+        throw std::runtime_error("LZ4 block decompressed to the wrong size!");
+    }
+    return out;
+}
@@ -0,0 +1,31 @@
+//
+//  compression.hpp
+//  n-body-cpp
+//
+//  Created by Jacob MacKenzie-Websdale on 19/10/2026.
+//
+
+#ifndef compression_hpp
+#define compression_hpp
+
+#include <stdio.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Standard CRC-32 (as used by PNG and zlib). Pass the previous result as
+// `crc` to continue a running checksum.
+uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc = 0);
+
+// Regroups `data` as consecutive `elementSize`-byte values into byte planes:
+// every value's first byte, then every value's second byte, and so on. Float
+// streams then put their slowly varying sign/exponent bytes side by side.
+std::vector<uint8_t> shuffleBytes(const uint8_t* data, size_t length, size_t elementSize);
+std::vector<uint8_t> unshuffleBytes(const uint8_t* data, size_t length, size_t elementSize);
+
+// LZ4 block format, greedy single-probe matcher. Decompression throws
+// std::runtime_error on malformed input or a size mismatch.
+std::vector<uint8_t> lz4Compress(const uint8_t* data, size_t length);
+std::vector<uint8_t> lz4Decompress(const uint8_t* data, size_t length, size_t decompressedLength);
+
+#endif /* compression_hpp */
@@ -6,17 +6,28 @@
 //
 
 #include "compute.hpp"
+#include "force.hpp"
 #include <GLFW/glfw3.h>
 #include <filesystem>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <cmath>
 #include "vulkan/vulkan.h"
 //
 //const char *shader =
 //#include "../shaders/shader.spv"
 //;
 
-uint8_t ComputeShaderInterface::setup() {
+// TODO : Make this inline or something...
+const std::string SHADER_DIRECTORY = "/Users/jacobmacweb/Documents/Projects/_personal/xcode/n-body-cpp/shaders/";
+
+uint8_t ComputeShaderInterface::setup(DisplayMode displayMode, ReductionMode reductionMode, uint32_t workgroupSize, const ForceModel& forceModel) {
+    this->displayMode = displayMode;
+    this->reductionMode = reductionMode;
+    this->workgroupSize = workgroupSize;
+    this->forceModel = forceModel;
+    
     std::cout << "Setting up Vulkan" << std::endl;
     if (setupVulkan() != EXIT_SUCCESS) {
         return EXIT_FAILURE;
@@ -41,15 +52,16 @@ uint8_t ComputeShaderInterface::setup() {
         return EXIT_FAILURE;
     }
     
-    std::cout << "Setting up Compute Pipeline" << std::endl;
-    if (setupComputePipeline() != EXIT_SUCCESS) {
+    std::cout << "Setting up Descriptor Sets" << std::endl;
+    if (createDescriptorSet() != EXIT_SUCCESS) {
         return EXIT_FAILURE;
     }
     
-    std::cout << "Setting up Descriptor Sets" << std::endl;
-    if (createDescriptorSet() != EXIT_SUCCESS) {
+    std::cout << "Setting up Compute Pipeline" << std::endl;
+    if (setupComputePipeline() != EXIT_SUCCESS) {
         return EXIT_FAILURE;
     }
+    
     std::cout << "Setting up Descriptor Pool" << std::endl;
     if (createDescriptorPool() != EXIT_SUCCESS) {
         return EXIT_FAILURE;
@@ -61,6 +73,16 @@ uint8_t ComputeShaderInterface::setup() {
     std::cout << "Re-allocating descriptor sets" << std::endl;
     allocateDescriptorSets();
     
+    std::cout << "Setting up timeline semaphores" << std::endl;
+    if (createSyncObjects() != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    
+    std::cout << "Recording command buffers" << std::endl;
+    if (recordCommandBuffers() != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    
     return EXIT_SUCCESS;
 }
 
@@ -72,7 +94,8 @@ uint8_t ComputeShaderInterface::setupVulkan() {
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    // 1.2 for core timeline semaphores
+    appInfo.apiVersion = VK_API_VERSION_1_2;
     
     VkInstanceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -134,17 +157,58 @@ void ComputeShaderInterface::setupPhysicalDevice() {
 }
 
 uint8_t ComputeShaderInterface::setupDevice() {
-    VkDeviceQueueCreateInfo queueCreateInfo{};
     float queuePriority = 1.0f;
+    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+    
+    VkDeviceQueueCreateInfo queueCreateInfo{};
     queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
     queueCreateInfo.queueFamilyIndex = computeQueueFamilyIndex;
     queueCreateInfo.queueCount = 1;
     queueCreateInfo.pQueuePriorities = &queuePriority;
+    queueCreateInfos.push_back(queueCreateInfo);
+    
+    if (transferQueueFamilyIndex != computeQueueFamilyIndex) {
+        queueCreateInfo.queueFamilyIndex = transferQueueFamilyIndex;
+        queueCreateInfos.push_back(queueCreateInfo);
+    }
+    
+    if (displayMode != DisplayMode::None && graphicsQueueFamilyIndex != computeQueueFamilyIndex && graphicsQueueFamilyIndex != transferQueueFamilyIndex) {
+        queueCreateInfo.queueFamilyIndex = graphicsQueueFamilyIndex;
+        queueCreateInfos.push_back(queueCreateInfo);
+    }
+    
+    VkPhysicalDeviceVulkan12Features features12{};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features12.timelineSemaphore = VK_TRUE;
+    
+    // Point sprites bigger than one pixel
+    VkPhysicalDeviceFeatures supportedFeatures{};
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+    VkPhysicalDeviceFeatures features{};
+    features.largePoints = displayMode != DisplayMode::None ? supportedFeatures.largePoints : VK_FALSE;
+    
+    // Only the deterministic module declares 64-bit integers
+    if (reductionMode == ReductionMode::Deterministic) {
+        if (!supportedFeatures.shaderInt64) {
+            std::cerr << "device does not support 64-bit integers in shaders!" << std::endl;
+            return EXIT_FAILURE;
+        }
+        features.shaderInt64 = VK_TRUE;
+    }
+    
+    std::vector<const char*> deviceExtensions;
+    if (displayMode == DisplayMode::Window) {
+        deviceExtensions.emplace_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
 
     VkDeviceCreateInfo deviceCreateInfo{};
     deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
-    deviceCreateInfo.queueCreateInfoCount = 1;
+    deviceCreateInfo.pNext = &features12;
+    deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
+    deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+    deviceCreateInfo.pEnabledFeatures = &features;
+    deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+    deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
     if (vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &device) != VK_SUCCESS) {
         std::cerr <<  "failed to create logical device!" << std::endl;
@@ -171,17 +235,46 @@ uint32_t ComputeShaderInterface::setupQueueFamilyIndex() {
         throw std::runtime_error("failed to find a queue family that supports compute operations");
     }
     
+    // A transfer-only family is usually backed by a DMA engine, so copies on it
+    // run alongside the compute queue instead of being serialised behind it.
+    transferQueueFamilyIndex = computeQueueFamilyIndex;
+    for (uint32_t i = 0; i < queueFamilyCount; i++) {
+        VkQueueFlags flags = queueFamilies[i].queueFlags;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_COMPUTE_BIT | VK_QUEUE_GRAPHICS_BIT))) {
+            std::cout << "Found transfer queue family: " << i << std::endl;
+            transferQueueFamilyIndex = i;
+            break;
+        }
+    }
+    
+    if (displayMode != DisplayMode::None) {
+        for (uint32_t i = 0; i < queueFamilyCount; i++) {
+            if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+                std::cout << "Found graphics queue family: " << i << std::endl;
+                graphicsQueueFamilyIndex = i;
+                break;
+            }
+        }
+        if (graphicsQueueFamilyIndex == -1) {
+            throw std::runtime_error("failed to find a queue family that supports graphics operations");
+        }
+    }
+    
     return computeQueueFamilyIndex;
 }
 
 uint8_t ComputeShaderInterface::setupQueue() {
     vkGetDeviceQueue(device, computeQueueFamilyIndex, 0, &computeQueue);
+    vkGetDeviceQueue(device, transferQueueFamilyIndex, 0, &transferQueue);
+    if (displayMode != DisplayMode::None) {
+        vkGetDeviceQueue(device, graphicsQueueFamilyIndex, 0, &graphicsQueue);
+    }
     
     return EXIT_SUCCESS;
 }
 
 // See: https://stackoverflow.com/a/38559209
-std::vector<char> ComputeShaderInterface::getShaderFromFile() {
+std::vector<char> ComputeShaderInterface::getShaderFromFile(const std::string& name) {
     std::vector<char> vec;
     std::ifstream file;
     file.exceptions(
@@ -195,8 +288,7 @@ std::vector<char> ComputeShaderInterface::getShaderFromFile() {
     
     std::filesystem::path cwd = std::filesystem::current_path();
     
-    // TODO : Make this inline or something...
-    file.open("/Users/jacobmacweb/Documents/Projects/_personal/xcode/n-body-cpp/shaders/shader.spv", std::ifstream::in | std::ifstream::binary);
+    file.open(SHADER_DIRECTORY + name, std::ifstream::in | std::ifstream::binary);
     file.seekg(0, std::ios::end);
     std::streampos length(file.tellg());
     if (length) {
@@ -208,8 +300,12 @@ std::vector<char> ComputeShaderInterface::getShaderFromFile() {
     return vec;
 }
 
+// Both modules are built from shaders/shader.comp by the Compile Shaders
+// build phase:
+//   glslc shader.comp -o shader.spv
+//   glslc -DDETERMINISTIC_REDUCTION shader.comp -o shader_deterministic.spv
 uint8_t ComputeShaderInterface::loadShader() {
-    std::vector<char> shaderCode = getShaderFromFile();
+    std::vector<char> shaderCode = getShaderFromFile(reductionMode == ReductionMode::Deterministic ? "shader_deterministic.spv" : "shader.spv");
     
     VkShaderModuleCreateInfo shaderModuleCreateInfo{};
     shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -227,10 +323,61 @@ uint8_t ComputeShaderInterface::loadShader() {
 uint8_t ComputeShaderInterface::setupComputePipeline() {
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
     if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
         std::cerr <<  "failed to create pipeline layout!" << std::endl;
         return EXIT_FAILURE;
     }
+    
+    return createComputePipeline();
+}
+
+uint8_t ComputeShaderInterface::createComputePipeline() {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    if (workgroupSize == 0 || workgroupSize > properties.limits.maxComputeWorkGroupSize[0] || workgroupSize > properties.limits.maxComputeWorkGroupInvocations) {
+        std::cerr << "unsupported workgroup size " << workgroupSize << std::endl;
+        return EXIT_FAILURE;
+    }
+    
+    // Matches the constant_ids in shader.comp and forces.glsl. The fast
+    // module has no constant 1, so it ignores that entry.
+    struct {
+        uint32_t workgroupSize;
+        int32_t fixedPointFractionBits;
+        int32_t pairLaw;
+        float softening;
+        float yukawaLength;
+        float centralMass;
+        int32_t haloProfile;
+        float haloMass;
+        float haloScale;
+        float externalCenter[3];
+    } specializationData = {
+        workgroupSize,
+        fixedPointFractionBits,
+        static_cast<int32_t>(forceModel.pairLaw),
+        forceModel.softening,
+        forceModel.yukawaLength,
+        forceModel.centralMass,
+        static_cast<int32_t>(forceModel.halo),
+        forceModel.haloMass,
+        forceModel.haloScale,
+        {forceModel.externalCenter[0], forceModel.externalCenter[1], forceModel.externalCenter[2]}
+    };
+    
+    // Every member is four bytes, so constant_id i sits at offset 4 i
+    std::array<VkSpecializationMapEntry, sizeof(specializationData) / 4> specializationEntries;
+    for (uint32_t i = 0; i < specializationEntries.size(); i++) {
+        specializationEntries[i] = {i, 4 * i, 4};
+    }
+    
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+    specializationInfo.pMapEntries = specializationEntries.data();
+    specializationInfo.dataSize = sizeof(specializationData);
+    specializationInfo.pData = &specializationData;
 
     VkComputePipelineCreateInfo pipelineCreateInfo{};
     pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
@@ -238,6 +385,7 @@ uint8_t ComputeShaderInterface::setupComputePipeline() {
     pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
     pipelineCreateInfo.stage.module = shaderModule;
     pipelineCreateInfo.stage.pName = "main";
+    pipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
     pipelineCreateInfo.layout = pipelineLayout;
 
     if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &computePipeline) != VK_SUCCESS) {
@@ -287,202 +435,540 @@ uint8_t ComputeShaderInterface::createDescriptorSet() {
 }
 
 uint8_t ComputeShaderInterface::createDescriptorPool() {
-    VkDescriptorPoolSize poolSize{};
-    poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSize.descriptorCount = 1;
-
-//    VkDescriptorPoolCreateInfo poolInfo{};
-//    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-//    poolInfo.poolSizeCount = 1;
-//    poolInfo.pPoolSizes = &poolSize;
-//    poolInfo.maxSets = 1;
-    
-    // This sizes the descriptor pool to match the demands of the descriptor sets
+    // This sizes the descriptor pool to match the demands of the descriptor sets,
+    // one set per upload slot and state buffer it can read from
+    const uint32_t setCount = UPLOAD_SLOT_COUNT * STATE_BUFFER_COUNT;
     VkDescriptorPoolSize poolSizes[] = {
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
-        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 }  // Two storage buffers
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, setCount },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * setCount }  // Two storage buffers per set
     };
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.poolSizeCount = sizeof(poolSizes) / sizeof(poolSizes[0]);
     poolInfo.pPoolSizes = poolSizes;
-    poolInfo.maxSets = 1;  // Number of descriptor sets
+    poolInfo.maxSets = setCount;  // Number of descriptor sets
 
     if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create descriptor pool!");
-    }
-
-    VkDescriptorSetAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &descriptorSetLayout;
-
-    auto result = vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet);
-    if (result != VK_SUCCESS) {
-        std::cerr << "failed to allocate descriptor set: " << result << std::endl;
+        std::cerr << "failed to create descriptor pool!" << std::endl;
         return EXIT_FAILURE;
     }
 
-    // Update descriptor sets with the uniform, input, and output buffers
     return EXIT_SUCCESS;
 }
 
 
 // Buffers
 void ComputeShaderInterface::createUniformBuffer() {
-    genericCreateBuffer(device, physicalDevice, sizeof(UniformBlock), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffer, uniformBufferMemory);
-    
-    uniformBufferInfo.buffer = uniformBuffer; // Your UBO VkBuffer
-    uniformBufferInfo.offset = 0; // Start from the beginning of the buffer
-    uniformBufferInfo.range = sizeof(UniformBlock); // The size of your UBO data
-
-    
+    for (size_t i = 0; i < uniformBuffers.size(); i++) {
+        genericCreateBuffer(device, physicalDevice, sizeof(UniformBlock), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i], uniformBufferMemory[i]);
+        
+        uniformBufferInfo[i].buffer = uniformBuffers[i]; // Your UBO VkBuffer
+        uniformBufferInfo[i].offset = 0; // Start from the beginning of the buffer
+        uniformBufferInfo[i].range = sizeof(UniformBlock); // The size of your UBO data
+    }
 }
 
-void ComputeShaderInterface::createInputBuffer() {
-    genericCreateBuffer(device, physicalDevice, sizeof(InputData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, inputBuffer, inputBufferMemory);
+void ComputeShaderInterface::createStateBuffers() {
+    // Every queue touches the state buffers, so share them rather than
+    // transferring ownership on every snapshot or frame
+    std::vector<uint32_t> families = {computeQueueFamilyIndex, transferQueueFamilyIndex};
+    if (displayMode != DisplayMode::None) {
+        families.push_back(graphicsQueueFamilyIndex);
+    }
     
-    inputBufferInfo.buffer = inputBuffer; // Your input data VkBuffer
-    inputBufferInfo.offset = 0; // Start from the beginning of the buffer
-    inputBufferInfo.range = sizeof(InputData); // Size of the input data
-
-}
-
-void ComputeShaderInterface::createOutputBuffer() {
-    genericCreateBuffer(device, physicalDevice, sizeof(OutputData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, outputBuffer, outputBufferMemory);
+    // The renderer binds these directly as vertex buffers
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
     
-    outputBufferInfo.buffer = outputBuffer; // Your output data VkBuffer
-    outputBufferInfo.offset = 0; // Start from the beginning of the buffer
-    outputBufferInfo.range = sizeof(OutputData); // Size of the output data
+    for (size_t i = 0; i < stateBuffers.size(); i++) {
+        genericCreateBuffer(device, physicalDevice, sizeof(InputData), usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, stateBuffers[i], stateBufferMemory[i], families);
+        
+        stateBufferInfo[i].buffer = stateBuffers[i];
+        stateBufferInfo[i].offset = 0;
+        stateBufferInfo[i].range = sizeof(InputData);
+    }
+}
 
+void ComputeShaderInterface::createStagingBuffers() {
+    for (size_t i = 0; i < uploadBuffers.size(); i++) {
+        genericCreateBuffer(device, physicalDevice, sizeof(InputData), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uploadBuffers[i], uploadBufferMemory[i]);
+    }
     
+    for (size_t i = 0; i < readbackBuffers.size(); i++) {
+        genericCreateBuffer(device, physicalDevice, sizeof(OutputData), VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readbackBuffers[i], readbackBufferMemory[i]);
+    }
 }
 
 void ComputeShaderInterface::createAllBuffers() {
     createUniformBuffer();
-    createInputBuffer();
-    createOutputBuffer();
+    createStateBuffers();
+    createStagingBuffers();
 }
 
 void ComputeShaderInterface::allocateDescriptorSets() {
+    std::array<VkDescriptorSetLayout, UPLOAD_SLOT_COUNT * STATE_BUFFER_COUNT> layouts;
+    layouts.fill(descriptorSetLayout);
+    
     VkDescriptorSetAllocateInfo allocInfo = {};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &descriptorSetLayout;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+    allocInfo.pSetLayouts = layouts.data();
 
-    vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet);
+    if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate descriptor sets!");
+    }
 
-    std::array<VkWriteDescriptorSet, 3> descriptorWrites = {};
+    // Set slot * STATE_BUFFER_COUNT + i reads uniformBuffers[slot] and
+    // stateBuffers[i], and writes the next state buffer
+    for (size_t set = 0; set < descriptorSets.size(); set++) {
+        size_t slot = set / STATE_BUFFER_COUNT;
+        size_t i = set % STATE_BUFFER_COUNT;
+        std::array<VkWriteDescriptorSet, 3> descriptorWrites = {};
+
+        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[0].dstSet = descriptorSets[set];
+        descriptorWrites[0].dstBinding = 0;
+        descriptorWrites[0].dstArrayElement = 0;
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrites[0].descriptorCount = 1;
+        descriptorWrites[0].pBufferInfo = &uniformBufferInfo[slot];
+
+        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[1].dstSet = descriptorSets[set];
+        descriptorWrites[1].dstBinding = 1;
+        descriptorWrites[1].dstArrayElement = 0;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[1].descriptorCount = 1;
+        descriptorWrites[1].pBufferInfo = &stateBufferInfo[(i + 1) % STATE_BUFFER_COUNT];
+
+        descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[2].dstSet = descriptorSets[set];
+        descriptorWrites[2].dstBinding = 2;
+        descriptorWrites[2].dstArrayElement = 0;
+        descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[2].descriptorCount = 1;
+        descriptorWrites[2].pBufferInfo = &stateBufferInfo[i];
+
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+}
 
-    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[0].dstSet = descriptorSet;
-    descriptorWrites[0].dstBinding = 0;
-    descriptorWrites[0].dstArrayElement = 0;
-    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorWrites[0].descriptorCount = 1;
-    descriptorWrites[0].pBufferInfo = &uniformBufferInfo;
+uint8_t ComputeShaderInterface::createSyncObjects() {
+    VkSemaphoreTypeCreateInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timelineInfo.initialValue = 0;
+    
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &timelineInfo;
+    
+    if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &computeTimeline) != VK_SUCCESS ||
+        vkCreateSemaphore(device, &semaphoreInfo, nullptr, &transferTimeline) != VK_SUCCESS) {
+        std::cerr << "failed to create timeline semaphores!" << std::endl;
+        return EXIT_FAILURE;
+    }
+    
+    return EXIT_SUCCESS;
+}
+
+uint8_t ComputeShaderInterface::recordCommandBuffers() {
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = computeQueueFamilyIndex;
+    poolInfo.flags = 0; // Optional
+
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+        std::cerr << "failed to create command pool!" << std::endl;
+        return EXIT_FAILURE;
+    }
+    
+    // The upload and readback command buffers are re-recorded on every use
+    poolInfo.queueFamilyIndex = transferQueueFamilyIndex;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &transferCommandPool) != VK_SUCCESS) {
+        std::cerr << "failed to create transfer command pool!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = static_cast<uint32_t>(computeCommandBuffers.size());
+
+    if (vkAllocateCommandBuffers(device, &allocInfo, computeCommandBuffers.data()) != VK_SUCCESS) {
+        std::cerr << "failed to allocate command buffers!" << std::endl;
+        return EXIT_FAILURE;
+    }
+    
+    allocInfo.commandPool = transferCommandPool;
+    allocInfo.commandBufferCount = static_cast<uint32_t>(readbackCommandBuffers.size());
+    if (vkAllocateCommandBuffers(device, &allocInfo, readbackCommandBuffers.data()) != VK_SUCCESS) {
+        std::cerr << "failed to allocate command buffers!" << std::endl;
+        return EXIT_FAILURE;
+    }
+    
+    allocInfo.commandBufferCount = static_cast<uint32_t>(uploadCommandBuffers.size());
+    if (vkAllocateCommandBuffers(device, &allocInfo, uploadCommandBuffers.data()) != VK_SUCCESS) {
+        std::cerr << "failed to allocate command buffers!" << std::endl;
+        return EXIT_FAILURE;
+    }
 
-    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[1].dstSet = descriptorSet;
-    descriptorWrites[1].dstBinding = 1;
-    descriptorWrites[1].dstArrayElement = 0;
-    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    descriptorWrites[1].descriptorCount = 1;
-    descriptorWrites[1].pBufferInfo = &outputBufferInfo;
+    recordComputeCommandBuffers();
+    
+    return EXIT_SUCCESS;
+}
 
-    descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[2].dstSet = descriptorSet;
-    descriptorWrites[2].dstBinding = 2;
-    descriptorWrites[2].dstArrayElement = 0;
-    descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    descriptorWrites[2].descriptorCount = 1;
-    descriptorWrites[2].pBufferInfo = &inputBufferInfo;
+// Recorded once and resubmitted every step, or again when the pipeline is rebuilt
+void ComputeShaderInterface::recordComputeCommandBuffers() {
+    // Each buffer comes round again every STATE_BUFFER_COUNT steps, while up
+    // to MAX_STEPS_IN_FLIGHT are queued, so its last submission may be pending
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+    
+    // Consecutive steps share a queue but no semaphore: step k reads the buffer
+    // step k - 1 wrote, and overwrites the one step k - 2 read
+    VkMemoryBarrier stepBarrier{};
+    stepBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    stepBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    stepBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    for (size_t i = 0; i < computeCommandBuffers.size(); i++) {
+        vkBeginCommandBuffer(computeCommandBuffers[i], &beginInfo);
+        vkCmdPipelineBarrier(computeCommandBuffers[i], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &stepBarrier, 0, nullptr, 0, nullptr);
+        vkCmdBindPipeline(computeCommandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+        vkCmdBindDescriptorSets(computeCommandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[i], 0, nullptr);
+        // One workgroup per particle, see shader.comp
+        vkCmdDispatch(computeCommandBuffers[i], MAX_PARTICLE_COUNT, 1, 1);
+        vkEndCommandBuffer(computeCommandBuffers[i]);
+    }
+}
 
-    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+void ComputeShaderInterface::mapMemory() {
+    for (size_t i = 0; i < uploadBufferMemory.size(); i++) {
+        vkMapMemory(device, uploadBufferMemory[i], 0, sizeof(InputData), 0, &uploadData[i]);
+        vkMapMemory(device, uniformBufferMemory[i], 0, sizeof(UniformBlock), 0, &uniformData[i]);
+    }
+    for (size_t i = 0; i < readbackBufferMemory.size(); i++) {
+        vkMapMemory(device, readbackBufferMemory[i], 0, sizeof(OutputData), 0, &readbackData[i]);
+    }
+}
 
+// Blocks the host until `semaphore` reaches `value`
+static void waitTimeline(VkDevice device, VkSemaphore semaphore, uint64_t value) {
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &semaphore;
+    waitInfo.pValues = &value;
+    
+    vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
 }
 
-void ComputeShaderInterface::mapMemory(void** output) {
-    vkMapMemory(device, inputBufferMemory, 0, sizeof(InputData), 0, &inputData);
-    vkMapMemory(device, outputBufferMemory, 0, sizeof(OutputData), 0, output);
-    vkMapMemory(device, uniformBufferMemory, 0, sizeof(UniformBlock), 0, &uniformData);
+int32_t ComputeShaderInterface::fixedPointFractionBitsFor(const std::array<Particle, MAX_PARTICLE_COUNT>& particles) {
+    // No pair accelerates a particle by more than G m / MIN_INTERACTION_DISTANCE^2
+    // (softening and screening only lower it), so the sum of n - 1 of them is
+    // bounded by the heaviest mass. Scaled, that bound must stay under 2^62,
+    // leaving room for the rounding of each term.
+    float maxMass = 0;
+    for (const Particle& particle : particles) {
+        maxMass = std::max(maxMass, std::abs(particle.mass));
+    }
+    double bound = (MAX_PARTICLE_COUNT - 1) * (double) GRAVITY * maxMass / ((double) MIN_INTERACTION_DISTANCE * MIN_INTERACTION_DISTANCE);
+    if (bound <= 0) {
+        return MAX_FIXED_POINT_FRACTION_BITS;
+    }
+    
+    int32_t bits = (int32_t) std::floor(62 - std::log2(bound));
+    return std::clamp(bits, -MAX_FIXED_POINT_FRACTION_BITS, MAX_FIXED_POINT_FRACTION_BITS);
 }
 
 void ComputeShaderInterface::copyToBuffer(std::array<Particle, MAX_PARTICLE_COUNT> particles, float dt) {
+    uint32_t current = computeValue % STATE_BUFFER_COUNT;
+    
+    // The scale is a specialization constant, so a new one takes a new pipeline
+    if (reductionMode == ReductionMode::Deterministic) {
+        int32_t bits = fixedPointFractionBitsFor(particles);
+        if (bits != fixedPointFractionBits) {
+            waitTimeline(device, computeTimeline, computeValue);
+            vkDestroyPipeline(device, computePipeline, nullptr);
+            
+            fixedPointFractionBits = bits;
+            if (createComputePipeline() != EXIT_SUCCESS) {
+                throw std::runtime_error("failed to rebuild compute pipeline!");
+            }
+            vkResetCommandPool(device, commandPool, 0);
+            recordComputeCommandBuffers();
+        }
+    }
+    
+    // Steps already queued keep reading the other slot's uniform block; only
+    // this slot's last copy and the steps that read it have to be finished
+    uint32_t slot = (uploadSlot + 1) % UPLOAD_SLOT_COUNT;
+    waitTimeline(device, transferTimeline, slotTransferValue[slot]);
+    waitTimeline(device, computeTimeline, slotComputeValue[slot]);
+    
     InputData ip = {
         .input_data = particles
     };
     
-    memcpy(inputData, &ip, (size_t)sizeof(InputData));
+    memcpy(uploadData[slot], &ip, (size_t)sizeof(InputData));
 
     // Similarly for the uniform buffer
     UniformBlock ubo = {
-        .u_particle_count = MAX_PARTICLE_COUNT,
-        .u_dt =  dt
+        .u_dt =  dt,
+        .u_particle_count = MAX_PARTICLE_COUNT
     };
     
-    memcpy(uniformData, &ubo, sizeof(UniformBlock));
+    memcpy(uniformData[slot], &ubo, sizeof(UniformBlock));
+    this->dt = dt;
+    uploadSlot = slot;
+    
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    
+    VkBufferCopy region{};
+    region.size = sizeof(InputData);
+    
+    VkCommandBuffer commandBuffer = uploadCommandBuffers[slot];
+    vkResetCommandBuffer(commandBuffer, 0);
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    
+    // Readbacks earlier on the transfer queue may still be reading the target
+    VkBufferMemoryBarrier readBarrier{};
+    readBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    readBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    readBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    readBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    readBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    readBarrier.buffer = stateBuffers[current];
+    readBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &readBarrier, 0, nullptr);
+    
+    vkCmdCopyBuffer(commandBuffer, uploadBuffers[slot], stateBuffers[current], 1, &region);
+    vkEndCommandBuffer(commandBuffer);
+    
+    uint64_t signalValue = ++transferValue;
+    
+    // Every queued step reads or writes the target, so the copy waits for all
+    // of them on the GPU rather than the host draining the compute queue. A
+    // frame may still be drawing from it too.
+    std::array<VkSemaphore, 2> waitSemaphores = {computeTimeline, renderTimeline};
+    std::array<uint64_t, 2> waitValues = {computeValue, stateRenderValue[current]};
+    std::array<VkPipelineStageFlags, 2> waitStages = {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT};
+    uint32_t waitCount = renderTimeline != VK_NULL_HANDLE ? 2 : 1;
+    
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = waitCount;
+    timelineInfo.pWaitSemaphoreValues = waitValues.data();
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &signalValue;
+    
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = waitCount;
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &transferTimeline;
+    
+    vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE);
+    stateTransferValue[current] = signalValue;
+    uploadTransferValue[current] = signalValue;
+    slotTransferValue[slot] = signalValue;
 }
 
-void ComputeShaderInterface::dispatchShader() {
-    VkCommandPoolCreateInfo poolInfo{};
-    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    poolInfo.queueFamilyIndex = computeQueueFamilyIndex; // Use the correct queue family index
-    poolInfo.flags = 0; // Optional
+void ComputeShaderInterface::restoreState(const std::array<Particle, MAX_PARTICLE_COUNT>& particles, float dt, uint64_t step) {
+    copyToBuffer(particles, dt);
+    baseStep = step - computeValue;
+}
 
-    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create command pool!");
+void ComputeShaderInterface::dispatchShader(bool snapshot) {
+    // Keep the host from queueing an unbounded backlog
+    if (computeValue >= MAX_STEPS_IN_FLIGHT) {
+        waitTimeline(device, computeTimeline, computeValue - MAX_STEPS_IN_FLIGHT + 1);
     }
-
-    VkCommandBuffer commandBuffer;
     
-    // Barrier
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = commandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = 1;
+    uint32_t current = computeValue % STATE_BUFFER_COUNT;
+    uint32_t next = (current + 1) % STATE_BUFFER_COUNT;
+    
+    // Step k only has to wait for uploads into its input, and for any readback
+    // or frame still reading the buffer it now overwrites. The readback of
+    // step k - 1 is left to overlap.
+    std::array<VkSemaphore, 2> waitSemaphores = {transferTimeline, renderTimeline};
+    std::array<uint64_t, 2> waitValues = {std::max(uploadTransferValue[current], stateTransferValue[next]), stateRenderValue[next]};
+    std::array<VkPipelineStageFlags, 2> waitStages = {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT};
+    uint32_t waitCount = renderTimeline != VK_NULL_HANDLE ? 2 : 1;
+    uint64_t signalValue = ++computeValue;
+    slotComputeValue[uploadSlot] = signalValue;
+    
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = waitCount;
+    timelineInfo.pWaitSemaphoreValues = waitValues.data();
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &signalValue;
 
-    if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate command buffers!");
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = waitCount;
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &computeCommandBuffers[uploadSlot * STATE_BUFFER_COUNT + current];
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &computeTimeline;
+    
+    vkQueueSubmit(computeQueue, 1, &submitInfo, VK_NULL_HANDLE);
+    
+    if (!snapshot) {
+        return;
     }
-
+    
+    // Snapshots rotate through the readback buffers in order, whichever state
+    // buffer they come from. The host may still hold this one, and its last
+    // copy must have landed before the command buffer is re-recorded.
+    uint32_t readback = snapshotCount % STATE_BUFFER_COUNT;
+    if (readbackHeld[readback]) {
+        throw std::runtime_error("snapshot buffer still held since retrieveResult()!");
+    }
+    waitTimeline(device, transferTimeline, readbackTransferValue[readback]);
+    
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
+    
+    VkBufferCopy region{};
+    region.size = sizeof(InputData);
+    
+    VkCommandBuffer commandBuffer = readbackCommandBuffers[readback];
+    vkResetCommandBuffer(commandBuffer, 0);
     vkBeginCommandBuffer(commandBuffer, &beginInfo);
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
-    vkCmdDispatch(commandBuffer, 1, 1, 1);
+    vkCmdCopyBuffer(commandBuffer, stateBuffers[next], readbackBuffers[readback], 1, &region);
+    
+    // Make the copy visible to the host once transferTimeline says it landed
+    VkBufferMemoryBarrier hostBarrier{};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.buffer = readbackBuffers[readback];
+    hostBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &hostBarrier, 0, nullptr);
     vkEndCommandBuffer(commandBuffer);
-
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
     
-    vkQueueSubmit(computeQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(computeQueue);
+    uint64_t transferSignalValue = ++transferValue;
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    
+    VkTimelineSemaphoreSubmitInfo transferTimelineInfo{};
+    transferTimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    transferTimelineInfo.waitSemaphoreValueCount = 1;
+    transferTimelineInfo.pWaitSemaphoreValues = &signalValue;
+    transferTimelineInfo.signalSemaphoreValueCount = 1;
+    transferTimelineInfo.pSignalSemaphoreValues = &transferSignalValue;
+    
+    VkSubmitInfo transferSubmitInfo{};
+    transferSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    transferSubmitInfo.pNext = &transferTimelineInfo;
+    transferSubmitInfo.waitSemaphoreCount = 1;
+    transferSubmitInfo.pWaitSemaphores = &computeTimeline;
+    transferSubmitInfo.pWaitDstStageMask = &waitStage;
+    transferSubmitInfo.commandBufferCount = 1;
+    transferSubmitInfo.pCommandBuffers = &commandBuffer;
+    transferSubmitInfo.signalSemaphoreCount = 1;
+    transferSubmitInfo.pSignalSemaphores = &transferTimeline;
+    
+    vkQueueSubmit(transferQueue, 1, &transferSubmitInfo, VK_NULL_HANDLE);
+    stateTransferValue[next] = transferSignalValue;
+    readbackTransferValue[readback] = transferSignalValue;
+    readbackStep[readback] = getStepCount();
+    latestReadback = readback;
+    snapshotCount++;
 }
 
 void ComputeShaderInterface::retrieveResult(void** data) {
-    vkMapMemory(device, outputBufferMemory, 0, sizeof(OutputData), 0, data);
+    waitTimeline(device, transferTimeline, readbackTransferValue[latestReadback]);
+    readbackHeld[latestReadback] = true;
+    *data = readbackData[latestReadback];
 }
 
 void ComputeShaderInterface::retrieveResultCleanup() {
-    vkUnmapMemory(device, outputBufferMemory);
+    // Readback buffers stay persistently mapped until cleanup()
+    readbackHeld.fill(false);
+}
+
+SnapshotHandle ComputeShaderInterface::latestSnapshot() const {
+    return SnapshotHandle{latestReadback, readbackStep[latestReadback], readbackTransferValue[latestReadback]};
 }
 
-void ComputeShaderInterface::genericCreateBuffer(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+const void* ComputeShaderInterface::pollSnapshot(SnapshotHandle& snapshot) {
+    if (readbackTransferValue[snapshot.index] != snapshot.transferValue) {
+        snapshot.step = readbackStep[snapshot.index];
+        snapshot.transferValue = readbackTransferValue[snapshot.index];
+    }
+    
+    uint64_t completed = 0;
+    vkGetSemaphoreCounterValue(device, transferTimeline, &completed);
+    if (snapshot.transferValue == 0 || completed < snapshot.transferValue) {
+        return nullptr;
+    }
+    
+    return readbackData[snapshot.index];
+}
+
+StateView ComputeShaderInterface::latestState() {
+    uint64_t completed = 0;
+    vkGetSemaphoreCounterValue(device, computeTimeline, &completed);
+    
+    // State v lives in stateBuffers[v % STATE_BUFFER_COUNT] and is next
+    // overwritten by step v + STATE_BUFFER_COUNT - 1
+    uint64_t value = computeValue <= completed + STATE_BUFFER_COUNT - 1 ? completed : computeValue;
+    uint32_t index = value % STATE_BUFFER_COUNT;
+    
+    return StateView{stateBuffers[index], index, value, uploadTransferValue[index]};
+}
+
+void ComputeShaderInterface::releaseState(const StateView& state, VkSemaphore semaphore, uint64_t value) {
+    renderTimeline = semaphore;
+    stateRenderValue[state.index] = value;
+}
+
+void ComputeShaderInterface::detachRenderer() {
+    renderTimeline = VK_NULL_HANDLE;
+    stateRenderValue.fill(0);
+}
+
+void ComputeShaderInterface::waitIdle() {
+    waitTimeline(device, computeTimeline, computeValue);
+    waitTimeline(device, transferTimeline, transferValue);
+}
+
+void ComputeShaderInterface::genericCreateBuffer(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory, const std::vector<uint32_t>& queueFamilies) {
+    // Concurrent sharing needs at least two distinct families
+    std::vector<uint32_t> families = queueFamilies;
+    std::sort(families.begin(), families.end());
+    families.erase(std::unique(families.begin(), families.end()), families.end());
+    
     VkBufferCreateInfo bufferInfo{};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferInfo.size = size;
     bufferInfo.usage = usage;
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (families.size() > 1) {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(families.size());
+        bufferInfo.pQueueFamilyIndices = families.data();
+    }
 
     if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
         throw std::runtime_error("failed to create buffer!");
@@ -523,13 +1009,33 @@ uint32_t ComputeShaderInterface::findMemoryType(VkPhysicalDevice physicalDevice,
 }
 
 void ComputeShaderInterface::cleanup() {
+    waitIdle();
+    
+    vkDestroySemaphore(device, computeTimeline, nullptr);
+    vkDestroySemaphore(device, transferTimeline, nullptr);
     vkDestroyShaderModule(device, shaderModule, nullptr);
     vkDestroyPipeline(device, computePipeline, nullptr);
     vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
     // Destroy buffers, free memory, etc.
-    vkUnmapMemory(device, inputBufferMemory);
-    vkUnmapMemory(device, uniformBufferMemory);
+    for (size_t i = 0; i < uploadBuffers.size(); i++) {
+        vkUnmapMemory(device, uploadBufferMemory[i]);
+        vkUnmapMemory(device, uniformBufferMemory[i]);
+        vkDestroyBuffer(device, uploadBuffers[i], nullptr);
+        vkFreeMemory(device, uploadBufferMemory[i], nullptr);
+        vkDestroyBuffer(device, uniformBuffers[i], nullptr);
+        vkFreeMemory(device, uniformBufferMemory[i], nullptr);
+    }
+    for (size_t i = 0; i < readbackBuffers.size(); i++) {
+        vkUnmapMemory(device, readbackBufferMemory[i]);
+        vkDestroyBuffer(device, readbackBuffers[i], nullptr);
+        vkFreeMemory(device, readbackBufferMemory[i], nullptr);
+        vkDestroyBuffer(device, stateBuffers[i], nullptr);
+        vkFreeMemory(device, stateBufferMemory[i], nullptr);
+    }
     vkDestroyCommandPool(device, commandPool, nullptr);
+    vkDestroyCommandPool(device, transferCommandPool, nullptr);
     vkDestroyDevice(device, nullptr);
     vkDestroyInstance(instance, nullptr);
 }
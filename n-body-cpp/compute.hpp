@@ -10,7 +10,10 @@
 
 #include <stdio.h>
 #include "vulkan/vulkan.h"
+#include "forcemodel.hpp"
 #include <array>
+#include <string>
+#include <vector>
 
 const uint64_t MAX_PARTICLE_COUNT  = /* 100 */ 100;
 
@@ -35,45 +38,168 @@ struct UniformBlock {
     int u_particle_count;
 };
 
+// Which extra queues and device features setup() asks for
+enum class DisplayMode {
+    None,
+    Offscreen,  // graphics queue only, e.g. lavapipe with no display
+    Window      // graphics queue plus swapchain support
+};
+
+// How each particle's force sum is reduced across a workgroup's invocations
+enum class ReductionMode {
+    // Float partial sums: bit-identical from run to run, but only for the
+    // same workgroup size
+    Fast,
+    
+    // 64-bit fixed-point partial sums: bit-identical for any workgroup size,
+    // at some cost per pair. Runs a separate shader module, the only one that
+    // needs shaderInt64.
+    Deterministic
+};
+
+// Fraction bits of the fixed-point sums until the first upload derives them
+// from the particle masses, and the most either way
+const int32_t DEFAULT_FIXED_POINT_FRACTION_BITS = 32;
+const int32_t MAX_FIXED_POINT_FRACTION_BITS = 126;
+
+const uint32_t DEFAULT_WORKGROUP_SIZE = 64;
+
+// Compute steps rotate through this many state buffers. The third lets the
+// renderer sample one state while the next two steps are still running.
+const uint32_t STATE_BUFFER_COUNT = 3;
+
+// dispatchShader() blocks once this many steps are queued but unfinished
+const uint64_t MAX_STEPS_IN_FLIGHT = 8;
+
+// copyToBuffer() alternates between this many staging buffers and uniform
+// blocks, so an upload only waits for work using the one before last
+const uint32_t UPLOAD_SLOT_COUNT = 2;
+
+// A finished (or queued) state the renderer may read from. Work reading it
+// must wait for computeTimeline >= computeValue and
+// transferTimeline >= transferValue.
+struct StateView {
+    VkBuffer buffer;
+    uint32_t index;
+    uint64_t computeValue;
+    uint64_t transferValue;
+};
+
+// A readback queued by dispatchShader(true), holding the state after `step`
+struct SnapshotHandle {
+    uint32_t index;
+    uint64_t step;
+    uint64_t transferValue;
+};
+
 class ComputeShaderInterface {
     VkInstance instance;
     VkPhysicalDevice physicalDevice;
     VkDevice device;
     uint32_t computeQueueFamilyIndex = -1;
     VkQueue computeQueue;
+    
+    // Falls back to the compute family when the device has no transfer-only family
+    uint32_t transferQueueFamilyIndex = -1;
+    VkQueue transferQueue;
+    
+    // Only set up when a DisplayMode other than None is requested
+    DisplayMode displayMode = DisplayMode::None;
+    ReductionMode reductionMode = ReductionMode::Fast;
+    uint32_t workgroupSize = DEFAULT_WORKGROUP_SIZE;
+    ForceModel forceModel;
+    int32_t fixedPointFractionBits = DEFAULT_FIXED_POINT_FRACTION_BITS;
+    uint32_t graphicsQueueFamilyIndex = -1;
+    VkQueue graphicsQueue = VK_NULL_HANDLE;
     VkShaderModule shaderModule;
     
     
     VkPipelineLayout pipelineLayout;
     VkPipeline computePipeline;
     
-    // buffer
-    VkBuffer uniformBuffer;
-    VkDeviceMemory uniformBufferMemory;
-    VkBuffer inputBuffer;
-    VkDeviceMemory inputBufferMemory;
-    VkBuffer outputBuffer;
-    VkDeviceMemory outputBufferMemory;
+    // buffer, one uniform block per upload slot
+    std::array<VkBuffer, UPLOAD_SLOT_COUNT> uniformBuffers;
+    std::array<VkDeviceMemory, UPLOAD_SLOT_COUNT> uniformBufferMemory;
+    
+    // Device-local particle state, rotated between steps. Step k reads
+    // stateBuffers[k % STATE_BUFFER_COUNT] and writes the next one.
+    std::array<VkBuffer, STATE_BUFFER_COUNT> stateBuffers;
+    std::array<VkDeviceMemory, STATE_BUFFER_COUNT> stateBufferMemory;
+    
+    // Host-visible staging for uploads and snapshots. Snapshot n is copied into
+    // readbackBuffers[n % STATE_BUFFER_COUNT].
+    std::array<VkBuffer, UPLOAD_SLOT_COUNT> uploadBuffers;
+    std::array<VkDeviceMemory, UPLOAD_SLOT_COUNT> uploadBufferMemory;
+    std::array<VkBuffer, STATE_BUFFER_COUNT> readbackBuffers;
+    std::array<VkDeviceMemory, STATE_BUFFER_COUNT> readbackBufferMemory;
     
     // mappings
-    void* inputData;
-    void* uniformData;
+    std::array<void*, UPLOAD_SLOT_COUNT> uploadData;
+    std::array<void*, UPLOAD_SLOT_COUNT> uniformData;
+    std::array<void*, STATE_BUFFER_COUNT> readbackData;
     
-    // desciptor set
+    // desciptor set, one per upload slot and input state buffer:
+    // descriptorSets[slot * STATE_BUFFER_COUNT + i]
     VkDescriptorSetLayout descriptorSetLayout;
-    VkDescriptorSet descriptorSet;
+    std::array<VkDescriptorSet, UPLOAD_SLOT_COUNT * STATE_BUFFER_COUNT> descriptorSets;
     VkDescriptorPool descriptorPool;
     
     // data
     VkCommandPool commandPool;
+    VkCommandPool transferCommandPool;
+    
+    // Pre-recorded per input state buffer (and upload slot, indexed like
+    // descriptorSets). Readbacks are recorded per snapshot, like uploads.
+    std::array<VkCommandBuffer, UPLOAD_SLOT_COUNT * STATE_BUFFER_COUNT> computeCommandBuffers;
+    std::array<VkCommandBuffer, STATE_BUFFER_COUNT> readbackCommandBuffers;
+    std::array<VkCommandBuffer, UPLOAD_SLOT_COUNT> uploadCommandBuffers;
+    
+    // Timeline semaphores. computeTimeline reaches k + 1 once step k is
+    // written; transferTimeline counts every upload and readback submitted.
+    VkSemaphore computeTimeline;
+    VkSemaphore transferTimeline;
+    uint64_t computeValue = 0;
+    uint64_t transferValue = 0;
     
+    // Transfer value after which nothing on the transfer queue touches
+    // stateBuffers[i] any more, and after which the last upload into
+    // stateBuffers[i] has landed
+    std::array<uint64_t, STATE_BUFFER_COUNT> stateTransferValue = {};
+    std::array<uint64_t, STATE_BUFFER_COUNT> uploadTransferValue = {};
+    uint32_t latestReadback = 0;
     
-    VkDescriptorBufferInfo uniformBufferInfo;
-    VkDescriptorBufferInfo inputBufferInfo;
-    VkDescriptorBufferInfo outputBufferInfo;
+    // Upload slot the next steps read their uniform block from. A slot may be
+    // rewritten once transferTimeline reaches slotTransferValue[slot] (its
+    // staging copy is done) and computeTimeline reaches slotComputeValue[slot]
+    // (no step reads its uniform block any more).
+    uint32_t uploadSlot = 0;
+    std::array<uint64_t, UPLOAD_SLOT_COUNT> slotTransferValue = {};
+    std::array<uint64_t, UPLOAD_SLOT_COUNT> slotComputeValue = {};
+    
+    // Which readback last targeted readbackBuffers[i], and the step it holds
+    std::array<uint64_t, STATE_BUFFER_COUNT> readbackTransferValue = {};
+    std::array<uint64_t, STATE_BUFFER_COUNT> readbackStep = {};
+    
+    // Snapshots requested so far, and the readback buffers retrieveResult()
+    // has handed out since the last retrieveResultCleanup()
+    uint64_t snapshotCount = 0;
+    std::array<bool, STATE_BUFFER_COUNT> readbackHeld = {};
+    
+    // Steps taken before this run, when restarted from a checkpoint
+    uint64_t baseStep = 0;
+    float dt = 0;
+    
+    // Set by the renderer through releaseState(): a step or upload that
+    // overwrites stateBuffers[i] waits for renderTimeline >= stateRenderValue[i]
+    VkSemaphore renderTimeline = VK_NULL_HANDLE;
+    std::array<uint64_t, STATE_BUFFER_COUNT> stateRenderValue = {};
+    
+    
+    std::array<VkDescriptorBufferInfo, UPLOAD_SLOT_COUNT> uniformBufferInfo;
+    std::array<VkDescriptorBufferInfo, STATE_BUFFER_COUNT> stateBufferInfo;
     
 public:
-    uint8_t setup();
+    uint8_t setup(DisplayMode displayMode = DisplayMode::None, ReductionMode reductionMode = ReductionMode::Fast, uint32_t workgroupSize = DEFAULT_WORKGROUP_SIZE, const ForceModel& forceModel = ForceModel());
     
     // This is described in the order of execution.
     uint8_t setupVulkan();
@@ -82,36 +208,91 @@ public:
     uint32_t setupQueueFamilyIndex();
     uint8_t setupQueue();
     uint8_t loadShader();
-    uint8_t setupComputePipeline();
     
     // Descriptor sets
     uint8_t createDescriptorSet();
+    uint8_t setupComputePipeline();
+    uint8_t createComputePipeline();
     uint8_t createDescriptorPool();
     
     void createUniformBuffer();
-    void createInputBuffer();
-    void createOutputBuffer();
+    void createStateBuffers();
+    void createStagingBuffers();
     
     void createAllBuffers();
     
     void allocateDescriptorSets();
     
-    void mapMemory(void** output);
+    uint8_t createSyncObjects();
+    uint8_t recordCommandBuffers();
+    void recordComputeCommandBuffers();
+    
+    void mapMemory();
     
     // Data phase
+    
+    // Uploads go through the transfer queue into the current state buffer;
+    // the next dispatch waits for them on the transfer timeline. The copy
+    // itself waits on the GPU for the steps already queued, so the host only
+    // blocks while the other upload slot is still in use. In Deterministic
+    // mode, an upload that changes the fixed-point scale rebuilds the
+    // pipeline, waiting for the steps already queued first.
     void copyToBuffer(std::array<Particle, MAX_PARTICLE_COUNT> particles, float dt);
-    void dispatchShader();
     
+    // As copyToBuffer(), but resumes step counting at `step`
+    void restoreState(const std::array<Particle, MAX_PARTICLE_COUNT>& particles, float dt, uint64_t step);
+    
+    // Queues one step without waiting on the host. With `snapshot` set, the
+    // result is also copied out on the transfer queue, overlapping the
+    // following step's compute.
+    void dispatchShader(bool snapshot = true);
+    
+    // Waits for the most recent snapshot. The pointer stays valid until
+    // retrieveResultCleanup(); requesting STATE_BUFFER_COUNT further snapshots
+    // before then throws, as the last of them would overwrite it.
     void retrieveResult(void** data);
     void retrieveResultCleanup();
     
+    // Non-blocking counterpart of retrieveResult() for background consumers.
+    // pollSnapshot() returns nullptr until the readback has landed. If a later
+    // snapshot reuses the buffer first, `snapshot` is moved on to that one.
+    SnapshotHandle latestSnapshot() const;
+    const void* pollSnapshot(SnapshotHandle& snapshot);
+    
+    // Steps queued so far, including those before a restart
+    uint64_t getStepCount() const { return baseStep + computeValue; }
+    float getTimestep() const { return dt; }
+    
+    // Most fraction bits that keep every fixed-point sum over `particles` from
+    // overflowing, and those the Deterministic pipeline currently uses
+    static int32_t fixedPointFractionBitsFor(const std::array<Particle, MAX_PARTICLE_COUNT>& particles);
+    int32_t getFixedPointFractionBits() const { return fixedPointFractionBits; }
+    
+    void waitIdle();
+    
+    // Rendering. latestState() never blocks: it returns the newest completed
+    // state unless the steps already queued would overwrite it, in which case
+    // it returns the newest queued one. Call releaseState() once the reading
+    // work is submitted, before queuing more steps.
+    StateView latestState();
+    void releaseState(const StateView& state, VkSemaphore semaphore, uint64_t value);
+    void detachRenderer();
+    
+    VkInstance getInstance() const { return instance; }
+    VkPhysicalDevice getPhysicalDevice() const { return physicalDevice; }
+    VkDevice getDevice() const { return device; }
+    VkQueue getGraphicsQueue() const { return graphicsQueue; }
+    uint32_t getGraphicsQueueFamilyIndex() const { return graphicsQueueFamilyIndex; }
+    VkSemaphore getComputeTimeline() const { return computeTimeline; }
+    VkSemaphore getTransferTimeline() const { return transferTimeline; }
+    
     // Clean-up
     void cleanup();
-private:
-    std::vector<char> getShaderFromFile();
     
     // generic
-    void genericCreateBuffer(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+    std::vector<char> getShaderFromFile(const std::string& name);
+    
+    void genericCreateBuffer(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory, const std::vector<uint32_t>& queueFamilies = {});
     
     uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties);
 };
@@ -0,0 +1,551 @@
+//
+//  fmm.cpp
+//  n-body-cpp
+//
+//  Created by Jacob MacKenzie-Websdale on 19/10/2026.
+//
+
+#include "fmm.hpp"
+#include "force.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+
+// Stops subdividing when bodies (nearly) coincide
+const unsigned MAX_TREE_DEPTH = 21;
+
+// Softened pairs this many softening lengths apart differ from Newtonian ones
+// by under 1.5%, so the far field may treat them as 1/r
+const double FAR_FIELD_SOFTENING_LENGTHS = 10;
+
+FMMInterface::FMMInterface(unsigned order, unsigned leafSize, double theta, unsigned threadCount)
+    : order(order), leafSize(std::max(1u, leafSize)), theta(theta), pool(threadCount) {
+}
+
+uint8_t FMMInterface::setup(const ForceModel& forceModel) {
+    std::cout << "Setting up FMM (order " << order << ", " << pool.size() << " threads)" << std::endl;
+    if (theta <= 0 || theta >= 1) {
+        std::cerr << "FMM opening angle must be in (0, 1)" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (forceModel.pairLaw == PairLaw::Yukawa) {
+        std::cerr << "FMM expansions only hold for 1/r pair laws" << std::endl;
+        return EXIT_FAILURE;
+    }
+    this->forceModel = forceModel;
+
+    // The expansions know nothing of the cutoff or the softening, so cells
+    // whose bodies may come closer than either stay in the near field
+    minFarSeparation = MIN_INTERACTION_DISTANCE;
+    if (forceModel.pairLaw == PairLaw::Softened) {
+        minFarSeparation = std::max(minFarSeparation, FAR_FIELD_SOFTENING_LENGTHS * forceModel.softening);
+    }
+
+    setupExpansionTables();
+
+    return EXIT_SUCCESS;
+}
+
+int32_t FMMInterface::termIndex(int x, int y, int z) const {
+    if (x < 0 || y < 0 || z < 0 || x + y + z > (int) order) {
+        return -1;
+    }
+    return indexLookup[(x * (order + 1) + y) * (order + 1) + z];
+}
+
+void FMMInterface::setupExpansionTables() {
+    multiIndices.clear();
+    degree.clear();
+    degreeEnd.clear();
+    indexLookup.assign((order + 1) * (order + 1) * (order + 1), -1);
+
+    for (int n = 0; n <= (int) order; n++) {
+        for (int x = n; x >= 0; x--) {
+            for (int y = n - x; y >= 0; y--) {
+                int z = n - x - y;
+                indexLookup[(x * (order + 1) + y) * (order + 1) + z] = (int32_t) multiIndices.size();
+                multiIndices.push_back({x, y, z});
+                degree.push_back(n);
+            }
+        }
+        degreeEnd.push_back(multiIndices.size());
+    }
+    termCount = multiIndices.size();
+
+    lowerIndex.assign(termCount, -1);
+    lowerDimension.assign(termCount, -1);
+    minusOne.assign(termCount, {-1, -1, -1});
+    minusTwo.assign(termCount, {-1, -1, -1});
+    factorial.assign(termCount, 1);
+    inverseFactorial.assign(termCount, 1);
+
+    for (size_t k = 0; k < termCount; k++) {
+        const auto& m = multiIndices[k];
+        for (int d = 0; d < 3; d++) {
+            for (int i = 2; i <= m[d]; i++) {
+                factorial[k] *= i;
+            }
+
+            std::array<int, 3> lower = m;
+            lower[d] -= 1;
+            minusOne[k][d] = termIndex(lower[0], lower[1], lower[2]);
+            lower[d] -= 1;
+            minusTwo[k][d] = termIndex(lower[0], lower[1], lower[2]);
+
+            if (lowerIndex[k] == -1 && m[d] > 0) {
+                lowerIndex[k] = minusOne[k][d];
+                lowerDimension[k] = d;
+            }
+        }
+        inverseFactorial[k] = 1.0 / factorial[k];
+    }
+
+    sumIndex.assign(termCount * termCount, -1);
+    differenceIndex.assign(termCount * termCount, -1);
+    for (size_t a = 0; a < termCount; a++) {
+        for (size_t b = 0; b < termCount; b++) {
+            const auto& ma = multiIndices[a];
+            const auto& mb = multiIndices[b];
+            sumIndex[a * termCount + b] = termIndex(ma[0] + mb[0], ma[1] + mb[1], ma[2] + mb[2]);
+            differenceIndex[a * termCount + b] = termIndex(ma[0] - mb[0], ma[1] - mb[1], ma[2] - mb[2]);
+        }
+    }
+}
+
+// out[k] = d^k, divided by k! when `scaled`
+void FMMInterface::monomials(const double d[3], double* out, bool scaled) const {
+    out[0] = 1;
+    for (size_t k = 1; k < termCount; k++) {
+        out[k] = out[lowerIndex[k]] * d[lowerDimension[k]];
+    }
+
+    if (scaled) {
+        for (size_t k = 1; k < termCount; k++) {
+            out[k] *= inverseFactorial[k];
+        }
+    }
+}
+
+void FMMInterface::copyToBuffer(std::array<Particle, MAX_PARTICLE_COUNT> particles, float dt) {
+    copyToBuffer(std::vector<Particle>(particles.begin(), particles.end()), dt);
+}
+
+void FMMInterface::copyToBuffer(const std::vector<Particle>& particles, float dt) {
+    this->particles = particles;
+    this->dt = dt;
+}
+
+// Tree construction
+void FMMInterface::buildTree() {
+    size_t count = particles.size();
+
+    double lower[3] = {INFINITY, INFINITY, INFINITY};
+    double upper[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (const auto& particle : particles) {
+        const float position[3] = {particle.x, particle.y, particle.z};
+        for (int d = 0; d < 3; d++) {
+            lower[d] = std::min(lower[d], (double) position[d]);
+            upper[d] = std::max(upper[d], (double) position[d]);
+        }
+    }
+
+    Cell root{};
+    root.halfSize = 0;
+    for (int d = 0; d < 3; d++) {
+        root.center[d] = 0.5 * (lower[d] + upper[d]);
+        root.halfSize = std::max(root.halfSize, 0.5 * (upper[d] - lower[d]));
+    }
+    // Pad so bodies on the boundary still land strictly inside
+    root.halfSize = root.halfSize > 0 ? root.halfSize * 1.0001 : 1;
+    root.radius = root.halfSize * std::sqrt(3.0);
+    root.begin = 0;
+    root.end = (uint32_t) count;
+
+    bodyOrder.resize(count);
+    std::iota(bodyOrder.begin(), bodyOrder.end(), 0);
+
+    cells.clear();
+    cells.push_back(root);
+    splitCell(0, 0);
+
+    sortedParticles.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        sortedParticles[i] = particles[bodyOrder[i]];
+    }
+
+    pendingChildren = std::make_unique<std::atomic<uint32_t>[]>(cells.size());
+    for (size_t c = 0; c < cells.size(); c++) {
+        pendingChildren[c] = cells[c].childCount;
+    }
+}
+
+void FMMInterface::splitCell(uint32_t cell, unsigned depth) {
+    uint32_t begin = cells[cell].begin;
+    uint32_t end = cells[cell].end;
+    if (end - begin <= leafSize || depth >= MAX_TREE_DEPTH) {
+        return;
+    }
+
+    double center[3] = {cells[cell].center[0], cells[cell].center[1], cells[cell].center[2]};
+    double childHalf = cells[cell].halfSize / 2;
+
+    // Counting sort of the cell's bodies into octants
+    std::vector<uint8_t> octants(end - begin);
+    std::array<uint32_t, 8> counts = {};
+    for (uint32_t i = begin; i < end; i++) {
+        const Particle& particle = particles[bodyOrder[i]];
+        uint8_t octant = (particle.x > center[0]) | (particle.y > center[1]) << 1 | (particle.z > center[2]) << 2;
+        octants[i - begin] = octant;
+        counts[octant]++;
+    }
+
+    std::array<uint32_t, 8> offsets;
+    uint32_t offset = begin;
+    for (int o = 0; o < 8; o++) {
+        offsets[o] = offset;
+        offset += counts[o];
+    }
+
+    std::vector<uint32_t> sorted(end - begin);
+    std::array<uint32_t, 8> cursor = offsets;
+    for (uint32_t i = begin; i < end; i++) {
+        sorted[cursor[octants[i - begin]]++ - begin] = bodyOrder[i];
+    }
+    std::copy(sorted.begin(), sorted.end(), bodyOrder.begin() + begin);
+
+    uint32_t firstChild = (uint32_t) cells.size();
+    uint32_t childCount = 0;
+    for (int o = 0; o < 8; o++) {
+        if (counts[o] == 0) {
+            continue;
+        }
+
+        Cell child{};
+        child.center[0] = center[0] + (o & 1 ? childHalf : -childHalf);
+        child.center[1] = center[1] + (o & 2 ? childHalf : -childHalf);
+        child.center[2] = center[2] + (o & 4 ? childHalf : -childHalf);
+        child.halfSize = childHalf;
+        child.radius = childHalf * std::sqrt(3.0);
+        child.begin = offsets[o];
+        child.end = offsets[o] + counts[o];
+        child.parent = (int32_t) cell;
+        cells.push_back(child);
+        childCount++;
+    }
+
+    // `cells` may have reallocated, so only index from here on
+    cells[cell].firstChild = (int32_t) firstChild;
+    cells[cell].childCount = childCount;
+
+    for (uint32_t c = firstChild; c < firstChild + childCount; c++) {
+        splitCell(c, depth + 1);
+    }
+}
+
+void FMMInterface::interact(uint32_t target, uint32_t source, std::vector<std::vector<uint32_t>>& m2l, std::vector<std::vector<uint32_t>>& p2p) {
+    const Cell& t = cells[target];
+    const Cell& s = cells[source];
+
+    double distance2 = 0;
+    for (int d = 0; d < 3; d++) {
+        distance2 += (t.center[d] - s.center[d]) * (t.center[d] - s.center[d]);
+    }
+
+    // Bodies lie within `radius` of their cell's centre, so no pair across the
+    // two cells is closer than the gap between the bounding spheres
+    double gap = std::sqrt(distance2) - t.radius - s.radius;
+    if ((t.radius + s.radius) * (t.radius + s.radius) < theta * theta * distance2 && gap >= minFarSeparation) {
+        m2l[target].push_back(source);
+    } else if (t.isLeaf() && s.isLeaf()) {
+        p2p[target].push_back(source);
+    } else if (s.isLeaf() || (!t.isLeaf() && t.radius >= s.radius)) {
+        for (uint32_t c = t.firstChild; c < t.firstChild + t.childCount; c++) {
+            interact(c, source, m2l, p2p);
+        }
+    } else {
+        for (uint32_t c = s.firstChild; c < s.firstChild + s.childCount; c++) {
+            interact(target, c, m2l, p2p);
+        }
+    }
+}
+
+void FMMInterface::buildInteractionLists() {
+    std::vector<std::vector<uint32_t>> m2l(cells.size());
+    std::vector<std::vector<uint32_t>> p2p(cells.size());
+    interact(0, 0, m2l, p2p);
+
+    // Flatten into CSR
+    m2lOffsets.assign(1, 0);
+    p2pOffsets.assign(1, 0);
+    m2lSources.clear();
+    p2pSources.clear();
+    for (size_t c = 0; c < cells.size(); c++) {
+        m2lSources.insert(m2lSources.end(), m2l[c].begin(), m2l[c].end());
+        p2pSources.insert(p2pSources.end(), p2p[c].begin(), p2p[c].end());
+        m2lOffsets.push_back((uint32_t) m2lSources.size());
+        p2pOffsets.push_back((uint32_t) p2pSources.size());
+    }
+}
+
+// Passes
+void FMMInterface::p2m(uint32_t cell) {
+    const Cell& c = cells[cell];
+    double* M = &multipoles[cell * termCount];
+    std::vector<double> mono(termCount);
+
+    for (uint32_t i = c.begin; i < c.end; i++) {
+        const Particle& particle = sortedParticles[i];
+        double d[3] = {particle.x - c.center[0], particle.y - c.center[1], particle.z - c.center[2]};
+        monomials(d, mono.data(), true);
+        for (size_t k = 0; k < termCount; k++) {
+            M[k] += particle.mass * mono[k];
+        }
+    }
+}
+
+void FMMInterface::m2m(uint32_t cell) {
+    const Cell& parent = cells[cell];
+    double* M = &multipoles[cell * termCount];
+    std::vector<double> w(termCount);
+
+    for (uint32_t child = parent.firstChild; child < parent.firstChild + parent.childCount; child++) {
+        const double* childM = &multipoles[child * termCount];
+        double d[3];
+        for (int i = 0; i < 3; i++) {
+            d[i] = cells[child].center[i] - parent.center[i];
+        }
+        monomials(d, w.data(), true);
+
+        for (size_t k = 0; k < termCount; k++) {
+            double sum = 0;
+            for (size_t l = 0; l < degreeEnd[degree[k]]; l++) {
+                int32_t diff = differenceIndex[k * termCount + l];
+                if (diff >= 0) {
+                    sum += childM[l] * w[diff];
+                }
+            }
+            M[k] += sum;
+        }
+    }
+}
+
+void FMMInterface::m2l(uint32_t target, uint32_t source, std::vector<double>& T) {
+    double R[3];
+    double r2 = 0;
+    for (int d = 0; d < 3; d++) {
+        R[d] = cells[target].center[d] - cells[source].center[d];
+        r2 += R[d] * R[d];
+    }
+
+    // T[k] = D^k (1/r) / k!, by the standard Taylor recurrence
+    T[0] = 1 / std::sqrt(r2);
+    for (size_t k = 1; k < termCount; k++) {
+        double n = degree[k];
+        double first = 0, second = 0;
+        for (int d = 0; d < 3; d++) {
+            if (minusOne[k][d] >= 0) first += R[d] * T[minusOne[k][d]];
+            if (minusTwo[k][d] >= 0) second += T[minusTwo[k][d]];
+        }
+        T[k] = -((2 * n - 1) * first + (n - 1) * second) / (n * r2);
+    }
+
+    const double* M = &multipoles[source * termCount];
+    double* L = &locals[target * termCount];
+    for (size_t n = 0; n < termCount; n++) {
+        double sum = 0;
+        for (size_t k = 0; k < degreeEnd[order - degree[n]]; k++) {
+            int32_t m = sumIndex[n * termCount + k];
+            double term = M[k] * factorial[m] * T[m];
+            sum += degree[k] % 2 ? -term : term;
+        }
+        L[n] += sum * inverseFactorial[n];
+    }
+}
+
+void FMMInterface::l2l(uint32_t cell) {
+    const Cell& child = cells[cell];
+    const double* parentL = &locals[child.parent * termCount];
+    double* L = &locals[cell * termCount];
+    std::vector<double> w(termCount);
+
+    double d[3];
+    for (int i = 0; i < 3; i++) {
+        d[i] = child.center[i] - cells[child.parent].center[i];
+    }
+    monomials(d, w.data(), true);
+
+    for (size_t n = 0; n < termCount; n++) {
+        // Only terms of at least the same degree can contribute
+        double sum = 0;
+        for (size_t k = degree[n] ? degreeEnd[degree[n] - 1] : 0; k < termCount; k++) {
+            int32_t diff = differenceIndex[k * termCount + n];
+            if (diff >= 0) {
+                sum += parentL[k] * factorial[k] * w[diff];
+            }
+        }
+        L[n] += sum * inverseFactorial[n];
+    }
+}
+
+void FMMInterface::l2p(uint32_t cell) {
+    const Cell& c = cells[cell];
+    const double* L = &locals[cell * termCount];
+    std::vector<double> mono(termCount);
+
+    for (uint32_t i = c.begin; i < c.end; i++) {
+        const Particle& particle = sortedParticles[i];
+        double d[3] = {particle.x - c.center[0], particle.y - c.center[1], particle.z - c.center[2]};
+        monomials(d, mono.data(), false);
+
+        double gradient[3] = {0, 0, 0};
+        for (size_t n = 1; n < termCount; n++) {
+            for (int dim = 0; dim < 3; dim++) {
+                if (minusOne[n][dim] >= 0) {
+                    gradient[dim] += L[n] * multiIndices[n][dim] * mono[minusOne[n][dim]];
+                }
+            }
+        }
+
+        for (int dim = 0; dim < 3; dim++) {
+            farAcceleration[i][dim] = GRAVITY * gradient[dim];
+        }
+    }
+}
+
+template <typename Law>
+void FMMInterface::p2p(uint32_t target, const Law& law) {
+    const Cell& t = cells[target];
+
+    for (uint32_t i = t.begin; i < t.end; i++) {
+        float force[3] = {0, 0, 0};
+        for (uint32_t s = p2pOffsets[target]; s < p2pOffsets[target + 1]; s++) {
+            const Cell& source = cells[p2pSources[s]];
+            for (uint32_t j = source.begin; j < source.end; j++) {
+                if (j == i) continue;
+                accumulatePairwiseForce(law, sortedParticles[i], sortedParticles[j], force);
+            }
+        }
+        nearForce[i] = {force[0], force[1], force[2]};
+    }
+}
+
+// Upward pass: P2M at the leaves, then M2M once every child of a cell is done.
+// Finishing the root releases the downward pass.
+void FMMInterface::upward(uint32_t cell, TaskGroup& group) {
+    if (cells[cell].isLeaf()) {
+        p2m(cell);
+    } else {
+        m2m(cell);
+    }
+
+    int32_t parent = cells[cell].parent;
+    if (parent < 0) {
+        pool.submit(group, [this, &group] { downward(0, group); });
+    } else if (pendingChildren[parent].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        pool.submit(group, [this, &group, parent] { upward(parent, group); });
+    }
+}
+
+// Downward pass: M2L into the cell and L2L from its parent, then either L2P or
+// the children. Every multipole is final by the time this starts.
+void FMMInterface::downward(uint32_t cell, TaskGroup& group) {
+    std::vector<double> derivatives(termCount);
+    for (uint32_t s = m2lOffsets[cell]; s < m2lOffsets[cell + 1]; s++) {
+        m2l(cell, m2lSources[s], derivatives);
+    }
+
+    if (cells[cell].parent >= 0) {
+        l2l(cell);
+    }
+
+    if (cells[cell].isLeaf()) {
+        l2p(cell);
+        return;
+    }
+
+    for (uint32_t c = cells[cell].firstChild; c < cells[cell].firstChild + cells[cell].childCount; c++) {
+        pool.submit(group, [this, &group, c] { downward(c, group); });
+    }
+}
+
+template <typename Field>
+void FMMInterface::integrate(const Field& field) {
+    next.resize(particles.size());
+
+    pool.parallelFor(sortedParticles.size(), 4096, [this, &field](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const Particle& particle1 = sortedParticles[i];
+
+            float external[3] = {0, 0, 0};
+            field.accumulate(particle1, external);
+
+            // Same integrator as the compute shader
+            float velocity[3] = {particle1.vx, particle1.vy, particle1.vz};
+            for (int d = 0; d < 3; d++) {
+                float acceleration = nearForce[i][d] / particle1.mass + (float) farAcceleration[i][d] + external[d];
+                velocity[d] += acceleration * dt;
+            }
+
+            Particle new_particle;
+            new_particle.x = particle1.x + velocity[0] * dt;
+            new_particle.y = particle1.y + velocity[1] * dt;
+            new_particle.z = particle1.z + velocity[2] * dt;
+            new_particle.vx = velocity[0];
+            new_particle.vy = velocity[1];
+            new_particle.vz = velocity[2];
+            new_particle.mass = particle1.mass;
+
+            next[bodyOrder[i]] = new_particle;
+        }
+    });
+
+    particles.swap(next);
+}
+
+void FMMInterface::dispatchShader() {
+    if (particles.empty()) {
+        return;
+    }
+
+    buildTree();
+    buildInteractionLists();
+
+    multipoles.assign(cells.size() * termCount, 0);
+    locals.assign(cells.size() * termCount, 0);
+    nearForce.assign(sortedParticles.size(), {0, 0, 0});
+    farAcceleration.assign(sortedParticles.size(), {0, 0, 0});
+
+    // The near field does not depend on any expansion, so P2P runs alongside
+    // the upward and downward passes
+    TaskGroup group;
+    withPairLaw(forceModel, [this, &group](auto law) {
+        for (uint32_t c = 0; c < cells.size(); c++) {
+            if (!cells[c].isLeaf()) {
+                continue;
+            }
+            pool.submit(group, [this, c, law] { p2p(c, law); });
+            pool.submit(group, [this, &group, c] { upward(c, group); });
+        }
+    });
+    pool.wait(group);
+
+    withExternalField(forceModel, [this](const auto& field) { integrate(field); });
+}
+
+void FMMInterface::retrieveResult(void** data) {
+    *data = particles.data();
+}
+
+void FMMInterface::retrieveResultCleanup() {
+    // Results live in host memory; nothing to release
+}
+
+void FMMInterface::cleanup() {
+    particles.clear();
+    next.clear();
+    sortedParticles.clear();
+    cells.clear();
+    multipoles.clear();
+    locals.clear();
+}
@@ -0,0 +1,136 @@
+//
+//  fmm.hpp
+//  n-body-cpp
+//
+//  Created by Jacob MacKenzie-Websdale on 19/10/2026.
+//
+
+#ifndef fmm_hpp
+#define fmm_hpp
+
+#include <stdio.h>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "compute.hpp"
+#include "forcemodel.hpp"
+#include "threadpool.hpp"
+
+// Fast multipole method on the CPU, exposing the same step interface as
+// ComputeShaderInterface. Expansions are Cartesian Taylor series truncated at
+// total degree `order`; near-field pairs go through accumulatePairwiseForce().
+// Every sum is owned by a single task and runs in a fixed order, so results
+// are bit-identical whatever the thread count.
+class FMMInterface {
+    struct Cell {
+        double center[3];
+        double halfSize;
+        double radius;
+
+        // Range into the sorted body arrays
+        uint32_t begin, end;
+        int32_t parent = -1;
+        int32_t firstChild = -1;
+        uint32_t childCount = 0;
+
+        bool isLeaf() const { return childCount == 0; }
+    };
+
+    unsigned order;
+    unsigned leafSize;
+    double theta;
+    ThreadPool pool;
+
+    ForceModel forceModel;
+    float dt = 0;
+
+    // Cell pairs whose bodies may be closer than this go through P2P
+    double minFarSeparation = 0;
+
+    std::vector<Particle> particles;
+    std::vector<Particle> next;
+
+    // Multi-index tables, ordered by total degree
+    size_t termCount;
+    std::vector<std::array<int, 3>> multiIndices;
+    std::vector<int> degree;
+    std::vector<size_t> degreeEnd;
+    std::vector<int32_t> lowerIndex;
+    std::vector<int32_t> lowerDimension;
+    std::vector<std::array<int32_t, 3>> minusOne;
+    std::vector<std::array<int32_t, 3>> minusTwo;
+    std::vector<double> factorial;
+    std::vector<double> inverseFactorial;
+    std::vector<int32_t> indexLookup;
+
+    // termCount x termCount: index of a + b (M2L) and of a - b (M2M, L2L),
+    // or -1 when that term is out of range
+    std::vector<int32_t> sumIndex;
+    std::vector<int32_t> differenceIndex;
+
+    // Tree, rebuilt every step. Children of a cell are contiguous.
+    std::vector<Cell> cells;
+    std::vector<uint32_t> bodyOrder;
+    std::vector<Particle> sortedParticles;
+    std::vector<uint32_t> m2lOffsets, m2lSources;
+    std::vector<uint32_t> p2pOffsets, p2pSources;
+    std::unique_ptr<std::atomic<uint32_t>[]> pendingChildren;
+
+    // Per cell, termCount coefficients each
+    std::vector<double> multipoles;
+    std::vector<double> locals;
+
+    // Per sorted body
+    std::vector<std::array<float, 3>> nearForce;
+    std::vector<std::array<double, 3>> farAcceleration;
+
+public:
+    explicit FMMInterface(unsigned order = 4, unsigned leafSize = 64, double theta = 0.5, unsigned threadCount = std::thread::hardware_concurrency());
+
+    // The far field is a 1/r expansion, so Yukawa pairs are rejected. Cells
+    // only interact through it once every pair across them is beyond
+    // MIN_INTERACTION_DISTANCE, and for softened pairs several softening
+    // lengths; anything closer is summed pair by pair.
+    uint8_t setup(const ForceModel& forceModel = ForceModel());
+
+    // Data phase
+    void copyToBuffer(std::array<Particle, MAX_PARTICLE_COUNT> particles, float dt);
+    void copyToBuffer(const std::vector<Particle>& particles, float dt);
+
+    // Advances one step. The result becomes the input of the next step.
+    void dispatchShader();
+
+    void retrieveResult(void** data);
+    void retrieveResultCleanup();
+
+    // Clean-up
+    void cleanup();
+
+private:
+    void setupExpansionTables();
+    int32_t termIndex(int x, int y, int z) const;
+
+    // Tree construction
+    void buildTree();
+    void splitCell(uint32_t cell, unsigned depth);
+    void buildInteractionLists();
+    void interact(uint32_t target, uint32_t source, std::vector<std::vector<uint32_t>>& m2l, std::vector<std::vector<uint32_t>>& p2p);
+
+    // Passes
+    void upward(uint32_t cell, TaskGroup& group);
+    void downward(uint32_t cell, TaskGroup& group);
+    void p2m(uint32_t cell);
+    void m2m(uint32_t cell);
+    void m2l(uint32_t target, uint32_t source, std::vector<double>& derivatives);
+    void l2l(uint32_t cell);
+    void l2p(uint32_t cell);
+    template <typename Law>
+    void p2p(uint32_t target, const Law& law);
+
+    void monomials(const double d[3], double* out, bool scaled) const;
+    template <typename Field>
+    void integrate(const Field& field);
+};
+
+#endif /* fmm_hpp */
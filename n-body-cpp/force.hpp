@@ -0,0 +1,137 @@
+//
+//  force.hpp
+//  n-body-cpp
+//
+//  Created by Jacob MacKenzie-Websdale on 19/10/2026.
+//
+
+#ifndef force_hpp
+#define force_hpp
+
+#include <stdio.h>
+#include <cmath>
+#include "compute.hpp"
+#include "forcemodel.hpp"
+
+// Must match shaders/forces.glsl
+const float GRAVITY = 0.000000000066742;
+const float MIN_INTERACTION_DISTANCE = 0.1;
+
+// Pair laws, mirroring pair_force() in shaders/forces.glsl. Each gives the
+// magnitude of the force between two particles `d_sqrt` apart.
+struct NewtonianLaw {
+    float operator()(float d_sqrt, float mass1, float mass2) const {
+        return (GRAVITY * mass1 * mass2) / (d_sqrt * d_sqrt);
+    }
+};
+
+struct SoftenedLaw {
+    float softening;
+
+    float operator()(float d_sqrt, float mass1, float mass2) const {
+        float softened = d_sqrt * d_sqrt + softening * softening;
+        return (GRAVITY * mass1 * mass2) * d_sqrt / (softened * std::sqrt(softened));
+    }
+};
+
+struct YukawaLaw {
+    float length;
+
+    float operator()(float d_sqrt, float mass1, float mass2) const {
+        float x = d_sqrt / length;
+        return (GRAVITY * mass1 * mass2) * (1 + x) * std::exp(-x) / (d_sqrt * d_sqrt);
+    }
+};
+
+// Adds the force `particle2` exerts on `particle1` to `force`, using the same
+// formula (and cutoff) as the compute shader
+template <typename Law>
+inline void accumulatePairwiseForce(const Law& law, const Particle& particle1, const Particle& particle2, float force[3]) {
+    float dx = particle2.x - particle1.x;
+    float dy = particle2.y - particle1.y;
+    float dz = particle2.z - particle1.z;
+
+    float d_sqrt = std::sqrt(dx * dx + dy * dy + dz * dz);
+    if (d_sqrt < MIN_INTERACTION_DISTANCE) return;
+    float raw_force = law(d_sqrt, particle1.mass, particle2.mass);
+
+    force[0] += dx / d_sqrt * raw_force;
+    force[1] += dy / d_sqrt * raw_force;
+    force[2] += dz / d_sqrt * raw_force;
+}
+
+// The fixed central mass and halo, mirroring external_acceleration() in
+// shaders/forces.glsl. Terms switched off by the template arguments compile
+// away.
+template <bool CentralMass, HaloProfile Halo>
+struct ExternalField {
+    ForceModel model;
+
+    void accumulate(const Particle& particle, float acceleration[3]) const {
+        if constexpr (CentralMass || Halo != HaloProfile::None) {
+            float dx = model.externalCenter[0] - particle.x;
+            float dy = model.externalCenter[1] - particle.y;
+            float dz = model.externalCenter[2] - particle.z;
+
+            float r = std::sqrt(dx * dx + dy * dy + dz * dz);
+            if (r < MIN_INTERACTION_DISTANCE) return;
+
+            float mass = CentralMass ? model.centralMass : 0;
+            if constexpr (Halo == HaloProfile::Hernquist) {
+                float ratio = r / (r + model.haloScale);
+                mass += model.haloMass * ratio * ratio;
+            } else if constexpr (Halo == HaloProfile::NFW) {
+                float x = r / model.haloScale;
+                mass += model.haloMass * (std::log(1 + x) - x / (1 + x));
+            }
+
+            float magnitude = GRAVITY * mass / (r * r);
+            acceleration[0] += dx / r * magnitude;
+            acceleration[1] += dy / r * magnitude;
+            acceleration[2] += dz / r * magnitude;
+        }
+    }
+};
+
+// Call `body` with the pair law / external field `model` selects, so that
+// each selection gets its own instantiation of the kernel in `body`
+template <typename Body>
+inline void withPairLaw(const ForceModel& model, Body&& body) {
+    switch (model.pairLaw) {
+        case PairLaw::Softened:
+            body(SoftenedLaw{model.softening});
+            break;
+        case PairLaw::Yukawa:
+            body(YukawaLaw{model.yukawaLength});
+            break;
+        default:
+            body(NewtonianLaw{});
+            break;
+    }
+}
+
+template <HaloProfile Halo, typename Body>
+inline void withExternalField(const ForceModel& model, Body&& body) {
+    if (model.centralMass != 0) {
+        body(ExternalField<true, Halo>{model});
+    } else {
+        body(ExternalField<false, Halo>{model});
+    }
+}
+
+template <typename Body>
+inline void withExternalField(const ForceModel& model, Body&& body) {
+    switch (model.halo) {
+        case HaloProfile::Hernquist:
+            withExternalField<HaloProfile::Hernquist>(model, body);
+            break;
+        case HaloProfile::NFW:
+            withExternalField<HaloProfile::NFW>(model, body);
+            break;
+        default:
+            withExternalField<HaloProfile::None>(model, body);
+            break;
+    }
+}
+
+#endif /* force_hpp */
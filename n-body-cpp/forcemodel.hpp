@@ -0,0 +1,58 @@
+//
+//  forcemodel.hpp
+//  n-body-cpp
+//
+//  Created by Jacob MacKenzie-Websdale on 19/10/2026.
+//
+
+#ifndef forcemodel_hpp
+#define forcemodel_hpp
+
+#include <stdio.h>
+#include <cstdint>
+
+// Force between every pair of particles
+enum class PairLaw : int32_t {
+    Newtonian = 0,
+
+    // Plummer-softened: G m1 m2 r / (r^2 + softening^2)^(3/2)
+    Softened = 1,
+
+    // Screened: G m1 m2 (1 + r / yukawaLength) e^(-r / yukawaLength) / r^2
+    Yukawa = 2
+};
+
+// Static halo around externalCenter, given by its enclosed mass M(<r)
+enum class HaloProfile : int32_t {
+    None = 0,
+
+    // M(<r) = haloMass r^2 / (r + haloScale)^2
+    Hernquist = 1,
+
+    // M(<r) = haloMass (ln(1 + x) - x / (1 + x)), x = r / haloScale
+    NFW = 2
+};
+
+// Which force terms make up a step, with their parameters. shader.comp gets
+// these as specialization constants and the CPU engines instantiate their
+// kernels from them, so terms left out cost nothing per pair.
+//
+// Adding a term takes a field here, its constant_id and function in
+// shaders/forces.glsl, a matching entry in ComputeShaderInterface's
+// specialization data, and its C++ counterpart in force.hpp.
+struct ForceModel {
+    PairLaw pairLaw = PairLaw::Newtonian;
+    float softening = 0.1;
+    float yukawaLength = 10;
+
+    // Fixed point mass at externalCenter; zero disables it
+    float centralMass = 0;
+
+    HaloProfile halo = HaloProfile::None;
+    float haloMass = 0;
+    float haloScale = 1;
+
+    float externalCenter[3] = {0, 0, 0};
+};
+
+#endif /* forcemodel_hpp */
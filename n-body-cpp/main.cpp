@@ -1,7 +1,6 @@
-
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
- 
+
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -9,36 +8,190 @@
 #include <glm/mat4x4.hpp>
 
 #include "compute.hpp"
+#include "render.hpp"
+#include "checkpoint.hpp"
+#include "benchmark.hpp"
+#include <cctype>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+
+const uint32_t WINDOW_WIDTH = 800;
+const uint32_t WINDOW_HEIGHT = 600;
+
+std::array<Particle, MAX_PARTICLE_COUNT> initialParticles() {
+    std::array<Particle, MAX_PARTICLE_COUNT> particles;
+    std::mt19937 generator(0);
+    std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+
+    for (auto& particle : particles) {
+        particle = {position(generator), position(generator), position(generator), 0, 0, 0, 10000000000.0f};
+    }
+
+    return particles;
+}
+
+const uint64_t CHECKPOINT_INTERVAL = 1000;
+
+// Usage: n-body-cpp [--offscreen <frame.png> [steps]] [--checkpoint <prefix> [--restart]]
+//        n-body-cpp --benchmark [steps]
+// Force terms: [--pair-law newtonian|softened <length>|yukawa <length>]
+//              [--central-mass <mass>] [--halo hernquist|nfw <mass> <scale>]
+// Offscreen mode needs no display, so it also runs on lavapipe. With
+// --checkpoint, state is saved to <prefix>-<step>.nbcp every
+// CHECKPOINT_INTERVAL steps; --restart resumes from the newest one.
+int main(int argc, char** argv) {
+    bool offscreen = false;
+    std::string framePath;
+    int steps = 100;
+    std::string checkpointPrefix;
+    bool restart = false;
+    bool benchmark = false;
+    ForceModel forceModel;
+
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        // std::stoi and std::stof throw on values that are not numbers
+        try {
+            if (argument == "--offscreen" && i + 1 < argc) {
+                offscreen = true;
+                framePath = argv[++i];
+                if (i + 1 < argc && isdigit(argv[i + 1][0])) {
+                    steps = std::stoi(argv[++i]);
+                }
+            } else if (argument == "--checkpoint" && i + 1 < argc) {
+                checkpointPrefix = argv[++i];
+            } else if (argument == "--restart") {
+                restart = true;
+            } else if (argument == "--benchmark") {
+                benchmark = true;
+                if (i + 1 < argc && isdigit(argv[i + 1][0])) {
+                    steps = std::stoi(argv[++i]);
+                }
+            } else if (argument == "--pair-law" && i + 1 < argc) {
+                std::string law = argv[++i];
+                if (law == "softened" && i + 1 < argc) {
+                    forceModel.pairLaw = PairLaw::Softened;
+                    forceModel.softening = std::stof(argv[++i]);
+                } else if (law == "yukawa" && i + 1 < argc) {
+                    forceModel.pairLaw = PairLaw::Yukawa;
+                    forceModel.yukawaLength = std::stof(argv[++i]);
+                } else if (law != "newtonian") {
+                    std::cerr << "unknown pair law " << law << std::endl;
+                    return EXIT_FAILURE;
+                }
+            } else if (argument == "--central-mass" && i + 1 < argc) {
+                forceModel.centralMass = std::stof(argv[++i]);
+            } else if (argument == "--halo" && i + 3 < argc) {
+                std::string profile = argv[++i];
+                if (profile == "hernquist") {
+                    forceModel.halo = HaloProfile::Hernquist;
+                } else if (profile == "nfw") {
+                    forceModel.halo = HaloProfile::NFW;
+                } else {
+                    std::cerr << "unknown halo profile " << profile << std::endl;
+                    return EXIT_FAILURE;
+                }
+                forceModel.haloMass = std::stof(argv[++i]);
+                forceModel.haloScale = std::stof(argv[++i]);
+            } else {
+                std::cerr << "unknown argument " << argument << std::endl;
+                return EXIT_FAILURE;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "bad value " << argv[i] << " for argument " << argument << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (restart && checkpointPrefix.empty()) {
+        std::cerr << "--restart needs --checkpoint <prefix>" << std::endl;
+        return EXIT_FAILURE;
+    }
 
-int main() {
     glfwInit();
 
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    GLFWwindow* window = glfwCreateWindow(800, 600, "Vulkan window", nullptr, nullptr);
-    
+    if (benchmark) {
+        uint8_t result = runReductionBenchmark(initialParticles(), steps);
+        glfwTerminate();
+        return result;
+    }
+
+    GLFWwindow* window = nullptr;
+    if (!offscreen) {
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+        window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Vulkan window", nullptr, nullptr);
+    }
+
     ComputeShaderInterface csi;
-    
+
     uint32_t extensionCount = 0;
     vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
 
     std::cout << extensionCount << " extensions supported\n";
-    
-    
-    csi.setup();
-    std::array<Particle, MAX_PARTICLE_COUNT> particles;
-    void *output;
-    csi.mapMemory(&output);
-    csi.copyToBuffer(particles, 0.1);
-    csi.dispatchShader();
-    void *data;
-    csi.retrieveResult(&data);
-    csi.retrieveResultCleanup();
-    
 
+
+    if (csi.setup(offscreen ? DisplayMode::Offscreen : DisplayMode::Window, ReductionMode::Fast, DEFAULT_WORKGROUP_SIZE, forceModel) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    csi.mapMemory();
+    if (!restart || Checkpointer::restore(csi, checkpointPrefix) != EXIT_SUCCESS) {
+        csi.copyToBuffer(initialParticles(), 0.1);
+    }
+
+    ParticleRenderer renderer(csi);
+    if (renderer.setup(WINDOW_WIDTH, WINDOW_HEIGHT, window) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    std::unique_ptr<Checkpointer> checkpointer;
+    if (!checkpointPrefix.empty()) {
+        checkpointer = std::make_unique<Checkpointer>(csi, checkpointPrefix, CHECKPOINT_INTERVAL);
+        if (checkpointer->setup() != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    }
+    auto step = [&]() {
+        if (checkpointer) {
+            checkpointer->step();
+        } else {
+            csi.dispatchShader(false);
+        }
+    };
+
+    if (offscreen) {
+        for (int i = 0; i < steps; i++) {
+            step();
+        }
+
+        // Draw the final state rather than whichever one happened to be done
+        csi.waitIdle();
+        renderer.drawFrame();
+        uint8_t result = renderer.saveFrame(framePath);
+
+        if (checkpointer) {
+            checkpointer->cleanup();
+        }
+        renderer.cleanup();
+        csi.cleanup();
+        glfwTerminate();
+        return result;
+    }
+
+    // The simulation steps as fast as it can; frames are only drawn when the
+    // previous one has finished
     while(!glfwWindowShouldClose(window)) {
         glfwPollEvents();
+        step();
+        renderer.drawFrame();
+    }
+
+    if (checkpointer) {
+        checkpointer->cleanup();
     }
+    renderer.cleanup();
+    csi.cleanup();
 
     glfwDestroyWindow(window);
 
@@ -0,0 +1,781 @@
+//
+//  render.cpp
+//  n-body-cpp
+//
+//  Created by Jacob MacKenzie-Websdale on 19/10/2026.
+//
+
+#include "render.hpp"
+#include "compression.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+
+const VkFormat COLOR_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+
+ParticleRenderer::ParticleRenderer(ComputeShaderInterface& compute) : compute(compute) {
+}
+
+uint8_t ParticleRenderer::setup(uint32_t width, uint32_t height, GLFWwindow* window) {
+    this->width = width;
+    this->height = height;
+    this->window = window;
+    device = compute.getDevice();
+    graphicsQueue = compute.getGraphicsQueue();
+
+    if (graphicsQueue == VK_NULL_HANDLE) {
+        std::cerr << "compute interface was set up without a graphics queue!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (window != nullptr) {
+        std::cout << "Setting up Surface" << std::endl;
+        if (createSurface() != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+
+        std::cout << "Setting up Swapchain" << std::endl;
+        if (createSwapchain() != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::cout << "Setting up Colour Target" << std::endl;
+    if (createColorTarget() != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Setting up Render Pass" << std::endl;
+    if (createRenderPass() != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Setting up Graphics Pipeline" << std::endl;
+    if (createGraphicsPipeline() != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Setting up Render Commands" << std::endl;
+    if (createCommandObjects() != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+uint8_t ParticleRenderer::createSurface() {
+    if (glfwCreateWindowSurface(compute.getInstance(), window, nullptr, &surface) != VK_SUCCESS) {
+        std::cerr << "failed to create window surface!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    VkBool32 presentSupport = VK_FALSE;
+    vkGetPhysicalDeviceSurfaceSupportKHR(compute.getPhysicalDevice(), compute.getGraphicsQueueFamilyIndex(), surface, &presentSupport);
+    if (!presentSupport) {
+        std::cerr << "graphics queue family cannot present to the window!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+uint8_t ParticleRenderer::createSwapchain() {
+    VkPhysicalDevice physicalDevice = compute.getPhysicalDevice();
+
+    VkSurfaceCapabilitiesKHR capabilities;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &capabilities);
+    if (!(capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)) {
+        std::cerr << "swapchain images cannot be blitted to!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    uint32_t formatCount = 0;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, nullptr);
+    std::vector<VkSurfaceFormatKHR> formats(formatCount);
+    vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, formats.data());
+    if (formats.empty()) {
+        std::cerr << "surface has no formats!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    VkSurfaceFormatKHR surfaceFormat = formats[0];
+    for (const auto& format : formats) {
+        if (format.format == VK_FORMAT_B8G8R8A8_UNORM || format.format == COLOR_FORMAT) {
+            surfaceFormat = format;
+            break;
+        }
+    }
+
+    // Prefer modes that never block acquisition on vsync
+    uint32_t presentModeCount = 0;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, nullptr);
+    std::vector<VkPresentModeKHR> presentModes(presentModeCount);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, presentModes.data());
+
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    for (VkPresentModeKHR preferred : {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR}) {
+        if (std::find(presentModes.begin(), presentModes.end(), preferred) != presentModes.end()) {
+            presentMode = preferred;
+            break;
+        }
+    }
+
+    swapchainExtent = capabilities.currentExtent;
+    if (swapchainExtent.width == UINT32_MAX) {
+        swapchainExtent = {width, height};
+    }
+
+    uint32_t imageCount = capabilities.minImageCount + 1;
+    if (capabilities.maxImageCount > 0) {
+        imageCount = std::min(imageCount, capabilities.maxImageCount);
+    }
+
+    VkSwapchainCreateInfoKHR createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    createInfo.surface = surface;
+    createInfo.minImageCount = imageCount;
+    createInfo.imageFormat = surfaceFormat.format;
+    createInfo.imageColorSpace = surfaceFormat.colorSpace;
+    createInfo.imageExtent = swapchainExtent;
+    createInfo.imageArrayLayers = 1;
+    createInfo.imageUsage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    createInfo.preTransform = capabilities.currentTransform;
+    createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    createInfo.presentMode = presentMode;
+    createInfo.clipped = VK_TRUE;
+
+    if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapchain) != VK_SUCCESS) {
+        std::cerr << "failed to create swapchain!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    vkGetSwapchainImagesKHR(device, swapchain, &imageCount, nullptr);
+    swapchainImages.resize(imageCount);
+    vkGetSwapchainImagesKHR(device, swapchain, &imageCount, swapchainImages.data());
+
+    return EXIT_SUCCESS;
+}
+
+uint8_t ParticleRenderer::createColorTarget() {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = COLOR_FORMAT;
+    imageInfo.extent = {width, height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    if (vkCreateImage(device, &imageInfo, nullptr, &colorImage) != VK_SUCCESS) {
+        std::cerr << "failed to create colour image!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, colorImage, &memRequirements);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = compute.findMemoryType(compute.getPhysicalDevice(), memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &colorImageMemory) != VK_SUCCESS) {
+        std::cerr << "failed to allocate colour image memory!" << std::endl;
+        return EXIT_FAILURE;
+    }
+    vkBindImageMemory(device, colorImage, colorImageMemory, 0);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = colorImage;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = COLOR_FORMAT;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    if (vkCreateImageView(device, &viewInfo, nullptr, &colorImageView) != VK_SUCCESS) {
+        std::cerr << "failed to create colour image view!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Tightly packed RGBA rows for saveFrame()
+    compute.genericCreateBuffer(device, compute.getPhysicalDevice(), (VkDeviceSize) width * height * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, imageBuffer, imageBufferMemory);
+    vkMapMemory(device, imageBufferMemory, 0, (VkDeviceSize) width * height * 4, 0, &imageData);
+
+    return EXIT_SUCCESS;
+}
+
+uint8_t ParticleRenderer::createRenderPass() {
+    VkAttachmentDescription colorAttachment{};
+    colorAttachment.format = COLOR_FORMAT;
+    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+    VkAttachmentReference colorAttachmentRef{};
+    colorAttachmentRef.attachment = 0;
+    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorAttachmentRef;
+
+    // The previous frame's copy out of the image must finish before we clear
+    // it, and this frame's writes must land before the copy that follows
+    std::array<VkSubpassDependency, 2> dependencies{};
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
+
+    if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+        std::cerr << "failed to create render pass!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = renderPass;
+    framebufferInfo.attachmentCount = 1;
+    framebufferInfo.pAttachments = &colorImageView;
+    framebufferInfo.width = width;
+    framebufferInfo.height = height;
+    framebufferInfo.layers = 1;
+
+    if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS) {
+        std::cerr << "failed to create framebuffer!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+uint8_t ParticleRenderer::createGraphicsPipeline() {
+    // Built from shaders/particle.vert and particle.frag by the Compile Shaders
+    // build phase
+    std::vector<char> vertexCode = compute.getShaderFromFile("particle.vert.spv");
+    std::vector<char> fragmentCode = compute.getShaderFromFile("particle.frag.spv");
+
+    VkShaderModuleCreateInfo shaderModuleCreateInfo{};
+    shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderModuleCreateInfo.codeSize = vertexCode.size();
+    shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t*>(vertexCode.data());
+    if (vkCreateShaderModule(device, &shaderModuleCreateInfo, nullptr, &vertexShader) != VK_SUCCESS) {
+        std::cerr << "failed to create vertex shader module!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    shaderModuleCreateInfo.codeSize = fragmentCode.size();
+    shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t*>(fragmentCode.data());
+    if (vkCreateShaderModule(device, &shaderModuleCreateInfo, nullptr, &fragmentShader) != VK_SUCCESS) {
+        std::cerr << "failed to create fragment shader module!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::array<VkPipelineShaderStageCreateInfo, 2> stages{};
+    stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    stages[0].module = vertexShader;
+    stages[0].pName = "main";
+    stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    stages[1].module = fragmentShader;
+    stages[1].pName = "main";
+
+    // The storage buffer layout is an array of Particle, so read it as such
+    VkVertexInputBindingDescription binding{};
+    binding.binding = 0;
+    binding.stride = sizeof(Particle);
+    binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    VkVertexInputAttributeDescription position{};
+    position.location = 0;
+    position.binding = 0;
+    position.format = VK_FORMAT_R32G32B32_SFLOAT;
+    position.offset = offsetof(Particle, x);
+
+    VkPipelineVertexInputStateCreateInfo vertexInput{};
+    vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInput.vertexBindingDescriptionCount = 1;
+    vertexInput.pVertexBindingDescriptions = &binding;
+    vertexInput.vertexAttributeDescriptionCount = 1;
+    vertexInput.pVertexAttributeDescriptions = &position;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+
+    VkViewport viewport{0, 0, (float) width, (float) height, 0, 1};
+    VkRect2D scissor{{0, 0}, {width, height}};
+
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.pViewports = &viewport;
+    viewportState.scissorCount = 1;
+    viewportState.pScissors = &scissor;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.cullMode = VK_CULL_MODE_NONE;
+    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterizer.lineWidth = 1.0f;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    // Additive, so dense regions glow
+    VkPipelineColorBlendAttachmentState blendAttachment{};
+    blendAttachment.blendEnable = VK_TRUE;
+    blendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    blendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    blendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    blendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    blendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    blendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+    blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &blendAttachment;
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(ViewBlock);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        std::cerr << "failed to create graphics pipeline layout!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = static_cast<uint32_t>(stages.size());
+    pipelineInfo.pStages = stages.data();
+    pipelineInfo.pVertexInputState = &vertexInput;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.layout = pipelineLayout;
+    pipelineInfo.renderPass = renderPass;
+    pipelineInfo.subpass = 0;
+
+    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
+        std::cerr << "failed to create graphics pipeline!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+uint8_t ParticleRenderer::createCommandObjects() {
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = compute.getGraphicsQueueFamilyIndex();
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+        std::cerr << "failed to create graphics command pool!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS ||
+        vkAllocateCommandBuffers(device, &allocInfo, &presentCommandBuffer) != VK_SUCCESS) {
+        std::cerr << "failed to allocate graphics command buffer!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    VkSemaphoreTypeCreateInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timelineInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &timelineInfo;
+
+    if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderTimeline) != VK_SUCCESS) {
+        std::cerr << "failed to create render timeline semaphore!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Binary semaphores for the swapchain, one per image on the present side
+    semaphoreInfo.pNext = nullptr;
+    if (window != nullptr) {
+        renderFinished.resize(swapchainImages.size());
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailable) != VK_SUCCESS) {
+            std::cerr << "failed to create swapchain semaphores!" << std::endl;
+            return EXIT_FAILURE;
+        }
+        for (auto& semaphore : renderFinished) {
+            if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+                std::cerr << "failed to create swapchain semaphores!" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+void ParticleRenderer::recordFrame(const StateView& state) {
+    vkResetCommandBuffer(commandBuffer, 0);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    VkClearValue clearColor{};
+    clearColor.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = renderPass;
+    renderPassInfo.framebuffer = framebuffer;
+    renderPassInfo.renderArea = {{0, 0}, {width, height}};
+    renderPassInfo.clearValueCount = 1;
+    renderPassInfo.pClearValues = &clearColor;
+
+    VkDeviceSize offset = 0;
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ViewBlock), &view);
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &state.buffer, &offset);
+    vkCmdDraw(commandBuffer, MAX_PARTICLE_COUNT, 1, 0, 0);
+    vkCmdEndRenderPass(commandBuffer);
+
+    // Offscreen, the frame is read back in the same batch; with a window it is
+    // blitted by recordPresent() instead
+    if (window == nullptr) {
+        VkImageSubresourceLayers layers{};
+        layers.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        layers.layerCount = 1;
+
+        VkBufferImageCopy region{};
+        region.imageSubresource = layers;
+        region.imageExtent = {width, height, 1};
+        vkCmdCopyImageToBuffer(commandBuffer, colorImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, imageBuffer, 1, &region);
+
+        VkBufferMemoryBarrier hostBarrier{};
+        hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        hostBarrier.buffer = imageBuffer;
+        hostBarrier.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &hostBarrier, 0, nullptr);
+    }
+
+    vkEndCommandBuffer(commandBuffer);
+}
+
+void ParticleRenderer::recordPresent(uint32_t swapchainImage) {
+    vkResetCommandBuffer(presentCommandBuffer, 0);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(presentCommandBuffer, &beginInfo);
+
+    VkImageSubresourceLayers layers{};
+    layers.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    layers.layerCount = 1;
+
+    VkImage target = swapchainImages[swapchainImage];
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = target;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(presentCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkImageBlit blit{};
+    blit.srcSubresource = layers;
+    blit.srcOffsets[1] = {(int32_t) width, (int32_t) height, 1};
+    blit.dstSubresource = layers;
+    blit.dstOffsets[1] = {(int32_t) swapchainExtent.width, (int32_t) swapchainExtent.height, 1};
+    vkCmdBlitImage(presentCommandBuffer, colorImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, target, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_NEAREST);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    vkCmdPipelineBarrier(presentCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+
+    vkEndCommandBuffer(presentCommandBuffer);
+}
+
+bool ParticleRenderer::drawFrame() {
+    uint64_t finished = 0;
+    vkGetSemaphoreCounterValue(device, renderTimeline, &finished);
+    if (finished < renderValue) {
+        return false;
+    }
+
+    uint32_t imageIndex = 0;
+    if (window != nullptr) {
+        VkResult result = vkAcquireNextImageKHR(device, swapchain, 0, imageAvailable, VK_NULL_HANDLE, &imageIndex);
+        if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+            return false;
+        }
+    }
+
+    StateView state = compute.latestState();
+    recordFrame(state);
+
+    // The vertex fetch waits on the step (or upload) that produced the state.
+    // This batch only draws (and, offscreen, reads the frame back), so the
+    // step that next overwrites the state never waits on the swapchain.
+    std::array<VkSemaphore, 2> waitSemaphores = {compute.getComputeTimeline(), compute.getTransferTimeline()};
+    std::array<uint64_t, 2> waitValues = {state.computeValue, state.transferValue};
+    std::array<VkPipelineStageFlags, 2> waitStages = {VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT};
+    uint64_t drawValue = ++renderValue;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+    timelineInfo.pWaitSemaphoreValues = waitValues.data();
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &drawValue;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &renderTimeline;
+
+    vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+
+    // Steps that would overwrite this state now wait for the draw instead
+    compute.releaseState(state, renderTimeline, drawValue);
+
+    if (window == nullptr) {
+        return true;
+    }
+
+    // The blit waits on the draw and the swapchain image; the next frame's
+    // draw waits on the blit through drawFrame()'s check above
+    recordPresent(imageIndex);
+
+    std::array<VkSemaphore, 2> presentWaitSemaphores = {renderTimeline, imageAvailable};
+    std::array<uint64_t, 2> presentWaitValues = {drawValue, 0};
+    std::array<VkPipelineStageFlags, 2> presentWaitStages = {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT};
+
+    uint64_t presentValue = ++renderValue;
+    std::array<VkSemaphore, 2> signalSemaphores = {renderTimeline, renderFinished[imageIndex]};
+    std::array<uint64_t, 2> signalValues = {presentValue, 0};
+
+    VkTimelineSemaphoreSubmitInfo presentTimelineInfo{};
+    presentTimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    presentTimelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(presentWaitValues.size());
+    presentTimelineInfo.pWaitSemaphoreValues = presentWaitValues.data();
+    presentTimelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+    presentTimelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+    VkSubmitInfo presentSubmitInfo{};
+    presentSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    presentSubmitInfo.pNext = &presentTimelineInfo;
+    presentSubmitInfo.waitSemaphoreCount = static_cast<uint32_t>(presentWaitSemaphores.size());
+    presentSubmitInfo.pWaitSemaphores = presentWaitSemaphores.data();
+    presentSubmitInfo.pWaitDstStageMask = presentWaitStages.data();
+    presentSubmitInfo.commandBufferCount = 1;
+    presentSubmitInfo.pCommandBuffers = &presentCommandBuffer;
+    presentSubmitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+    presentSubmitInfo.pSignalSemaphores = signalSemaphores.data();
+
+    vkQueueSubmit(graphicsQueue, 1, &presentSubmitInfo, VK_NULL_HANDLE);
+
+    VkPresentInfoKHR presentInfo{};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = &renderFinished[imageIndex];
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = &swapchain;
+    presentInfo.pImageIndices = &imageIndex;
+
+    vkQueuePresentKHR(graphicsQueue, &presentInfo);
+
+    return true;
+}
+
+void ParticleRenderer::waitIdle() {
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &renderTimeline;
+    waitInfo.pValues = &renderValue;
+
+    vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+}
+
+// Minimal PNG encoder: one IDAT holding stored (uncompressed) deflate blocks
+static void appendBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+static void appendChunk(std::vector<uint8_t>& out, const char type[4], const std::vector<uint8_t>& data) {
+    appendBigEndian(out, (uint32_t) data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    appendBigEndian(out, crc32(&out[start], out.size() - start));
+}
+
+static bool writePNG(const std::string& path, uint32_t width, uint32_t height, const uint8_t* rgba) {
+    // Each scanline is prefixed with filter type 0
+    std::vector<uint8_t> raw;
+    raw.reserve((size_t) height * (width * 4 + 1));
+    for (uint32_t y = 0; y < height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgba + (size_t) y * width * 4, rgba + (size_t) (y + 1) * width * 4);
+    }
+
+    std::vector<uint8_t> zlib = {0x78, 0x01};
+    uint32_t a = 1, b = 0;
+    for (size_t offset = 0; ; offset += 65535) {
+        uint16_t length = (uint16_t) std::min<size_t>(65535, raw.size() - offset);
+        bool last = offset + length >= raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(length & 0xFF);
+        zlib.push_back(length >> 8);
+        zlib.push_back(~length & 0xFF);
+        zlib.push_back((~length >> 8) & 0xFF);
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+
+        for (size_t i = offset; i < offset + length; i++) {
+            a = (a + raw[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        if (last) {
+            break;
+        }
+    }
+    appendBigEndian(zlib, (b << 16) | a);
+
+    std::vector<uint8_t> header;
+    appendBigEndian(header, width);
+    appendBigEndian(header, height);
+    header.insert(header.end(), {8, 6, 0, 0, 0});  // 8-bit RGBA, no interlace
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    appendChunk(png, "IHDR", header);
+    appendChunk(png, "IDAT", zlib);
+    appendChunk(png, "IEND", {});
+
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(png.data()), png.size());
+    return file.good();
+}
+
+uint8_t ParticleRenderer::saveFrame(const std::string& path) {
+    if (window != nullptr || renderValue == 0) {
+        std::cerr << "no offscreen frame to save!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    waitIdle();
+
+    if (!writePNG(path, width, height, static_cast<const uint8_t*>(imageData))) {
+        std::cerr << "failed to write " << path << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+void ParticleRenderer::cleanup() {
+    waitIdle();
+    compute.detachRenderer();
+
+    if (window != nullptr) {
+        vkQueueWaitIdle(graphicsQueue);
+        vkDestroySemaphore(device, imageAvailable, nullptr);
+        for (auto semaphore : renderFinished) {
+            vkDestroySemaphore(device, semaphore, nullptr);
+        }
+        vkDestroySwapchainKHR(device, swapchain, nullptr);
+        vkDestroySurfaceKHR(compute.getInstance(), surface, nullptr);
+    }
+
+    vkDestroySemaphore(device, renderTimeline, nullptr);
+    vkDestroyCommandPool(device, commandPool, nullptr);
+    vkDestroyPipeline(device, graphicsPipeline, nullptr);
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    vkDestroyShaderModule(device, vertexShader, nullptr);
+    vkDestroyShaderModule(device, fragmentShader, nullptr);
+    vkDestroyFramebuffer(device, framebuffer, nullptr);
+    vkDestroyRenderPass(device, renderPass, nullptr);
+    vkDestroyImageView(device, colorImageView, nullptr);
+    vkDestroyImage(device, colorImage, nullptr);
+    vkFreeMemory(device, colorImageMemory, nullptr);
+    vkUnmapMemory(device, imageBufferMemory);
+    vkDestroyBuffer(device, imageBuffer, nullptr);
+    vkFreeMemory(device, imageBufferMemory, nullptr);
+}
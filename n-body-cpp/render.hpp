@@ -0,0 +1,106 @@
+//
+//  render.hpp
+//  n-body-cpp
+//
+//  Created by Jacob MacKenzie-Websdale on 19/10/2026.
+//
+
+#ifndef render_hpp
+#define render_hpp
+
+#include <stdio.h>
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <string>
+#include <vector>
+#include "compute.hpp"
+
+// Orthographic view onto the XY plane, pushed as constants to particle.vert
+struct ViewBlock {
+    float center_x;
+    float center_y;
+
+    // World units from the centre to the edge of the frame
+    float extent;
+    float point_size;
+};
+
+// Draws particles as point sprites straight out of the compute path's state
+// buffers, without any host copy. Frames render into an offscreen image that
+// is then blitted to the window's swapchain or read back for saveFrame().
+class ParticleRenderer {
+    ComputeShaderInterface& compute;
+    VkDevice device;
+    VkQueue graphicsQueue;
+    uint32_t width, height;
+
+    // Colour target
+    VkImage colorImage;
+    VkDeviceMemory colorImageMemory;
+    VkImageView colorImageView;
+    VkRenderPass renderPass;
+    VkFramebuffer framebuffer;
+
+    VkShaderModule vertexShader;
+    VkShaderModule fragmentShader;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline graphicsPipeline;
+
+    // Drawing, and with a window the blit to the swapchain, each submitted
+    // on their own
+    VkCommandPool commandPool;
+    VkCommandBuffer commandBuffer;
+    VkCommandBuffer presentCommandBuffer;
+
+    // Signalled once a frame has drawn from its state, and again once its
+    // blit is done. Reaches renderValue when the last frame is finished.
+    VkSemaphore renderTimeline;
+    uint64_t renderValue = 0;
+
+    // Offscreen readback
+    VkBuffer imageBuffer;
+    VkDeviceMemory imageBufferMemory;
+    void* imageData;
+
+    // Presentation, only used with a window
+    GLFWwindow* window = nullptr;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+    VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+    VkExtent2D swapchainExtent;
+    std::vector<VkImage> swapchainImages;
+    VkSemaphore imageAvailable;
+    std::vector<VkSemaphore> renderFinished;
+
+public:
+    ViewBlock view = {0, 0, 100, 2};
+
+    explicit ParticleRenderer(ComputeShaderInterface& compute);
+
+    // `compute` must already be set up with a DisplayMode matching `window`
+    uint8_t setup(uint32_t width, uint32_t height, GLFWwindow* window = nullptr);
+
+    // This is described in the order of execution.
+    uint8_t createSurface();
+    uint8_t createSwapchain();
+    uint8_t createColorTarget();
+    uint8_t createRenderPass();
+    uint8_t createGraphicsPipeline();
+    uint8_t createCommandObjects();
+
+    // Draws the latest state the compute path can spare. Never blocks: returns
+    // false and skips the frame while the previous one is still in flight.
+    bool drawFrame();
+
+    // Writes the last drawn frame to a PNG. Offscreen only.
+    uint8_t saveFrame(const std::string& path);
+
+    void waitIdle();
+
+    // Clean-up
+    void cleanup();
+private:
+    void recordFrame(const StateView& state);
+    void recordPresent(uint32_t swapchainImage);
+};
+
+#endif /* render_hpp */
@@ -0,0 +1,137 @@
+//
+//  threadpool.cpp
+//  n-body-cpp
+//
+//  Created by Jacob MacKenzie-Websdale on 19/10/2026.
+//
+
+#include "threadpool.hpp"
+#include <algorithm>
+
+// Identifies the pool (and queue) the current thread works for, if any
+static thread_local const ThreadPool* currentPool = nullptr;
+static thread_local size_t currentIndex = 0;
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+    threadCount = std::max(1u, threadCount);
+
+    // One queue per worker, plus a shared one for outside threads
+    for (unsigned i = 0; i <= threadCount; i++) {
+        queues.emplace_back(std::make_unique<Queue>());
+    }
+
+    for (unsigned i = 0; i < threadCount; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+unsigned ThreadPool::size() const {
+    return static_cast<unsigned>(workers.size());
+}
+
+size_t ThreadPool::currentQueue() const {
+    return currentPool == this ? currentIndex : workers.size();
+}
+
+void ThreadPool::submit(TaskGroup& group, std::function<void()> task) {
+    group.pending.fetch_add(1, std::memory_order_relaxed);
+
+    Queue& queue = *queues[currentQueue()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back({std::move(task), &group});
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued.fetch_add(1, std::memory_order_relaxed);
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::runOne(size_t self) {
+    Task task;
+    bool found = false;
+
+    {
+        Queue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            found = true;
+        }
+    }
+
+    // Steal the oldest task from someone else; it tends to be the largest
+    for (size_t i = 1; !found && i < queues.size(); i++) {
+        Queue& victim = *queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            found = true;
+        }
+    }
+
+    if (!found) {
+        return false;
+    }
+
+    queued.fetch_sub(1, std::memory_order_relaxed);
+    task.run();
+    task.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+
+    return true;
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    currentPool = this;
+    currentIndex = index;
+
+    while (true) {
+        if (runOne(index)) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stopping || queued.load(std::memory_order_relaxed) > 0; });
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::wait(TaskGroup& group) {
+    size_t self = currentQueue();
+
+    while (group.pending.load(std::memory_order_acquire) > 0) {
+        if (!runOne(self)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t chunk, const std::function<void(size_t, size_t)>& body) {
+    TaskGroup group;
+    chunk = std::max<size_t>(1, chunk);
+
+    for (size_t begin = 0; begin < count; begin += chunk) {
+        size_t end = std::min(count, begin + chunk);
+        submit(group, [&body, begin, end] { body(begin, end); });
+    }
+
+    wait(group);
+}
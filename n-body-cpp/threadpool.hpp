@@ -0,0 +1,73 @@
+//
+//  threadpool.hpp
+//  n-body-cpp
+//
+//  Created by Jacob MacKenzie-Websdale on 19/10/2026.
+//
+
+#ifndef threadpool_hpp
+#define threadpool_hpp
+
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts the tasks submitted against it that have not finished yet. Tasks may
+// submit further work to their own group, so a group doubles as a task DAG.
+struct TaskGroup {
+    std::atomic<size_t> pending{0};
+};
+
+// Work-stealing pool. Every worker owns a deque: it pushes and pops its own
+// work at the back and steals from the front of the others when it runs dry.
+// Threads that are not workers share one extra deque.
+class ThreadPool {
+    struct Task {
+        std::function<void()> run;
+        TaskGroup* group;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<size_t> queued{0};
+    bool stopping = false;
+
+public:
+    explicit ThreadPool(unsigned threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(TaskGroup& group, std::function<void()> task);
+
+    // Runs queued tasks on the calling thread until every task in `group`,
+    // including ones it spawned, has finished
+    void wait(TaskGroup& group);
+
+    // Splits [0, count) into chunks and waits for all of them
+    void parallelFor(size_t count, size_t chunk, const std::function<void(size_t, size_t)>& body);
+
+    unsigned size() const;
+
+private:
+    size_t currentQueue() const;
+    bool runOne(size_t self);
+    void workerLoop(size_t index);
+};
+
+#endif /* threadpool_hpp */
@@ -0,0 +1,75 @@
+// Force terms for shader.comp, selected and parameterised through
+// specialization constants (see ForceModel in forcemodel.hpp). Branches on
+// these constants are folded when the pipeline is built, so only the
+// selected terms end up in it.
+//
+// Included into both compute modules; the Compile Shaders build phase lists it
+// as an input, so editing it rebuilds them (see loadShader() in compute.cpp).
+
+// Must match GRAVITY and MIN_INTERACTION_DISTANCE in force.hpp
+const float GRAVITY = 0.000000000066742;
+const float MIN_INTERACTION_DISTANCE = 0.1;
+
+// PairLaw
+const int PAIR_NEWTONIAN = 0;
+const int PAIR_SOFTENED = 1;
+const int PAIR_YUKAWA = 2;
+
+// HaloProfile
+const int HALO_NONE = 0;
+const int HALO_HERNQUIST = 1;
+const int HALO_NFW = 2;
+
+layout(constant_id = 2) const int PAIR_LAW = PAIR_NEWTONIAN;
+layout(constant_id = 3) const float SOFTENING = 0.1;
+layout(constant_id = 4) const float YUKAWA_LENGTH = 10.0;
+layout(constant_id = 5) const float CENTRAL_MASS = 0.0;
+layout(constant_id = 6) const int HALO_PROFILE = HALO_NONE;
+layout(constant_id = 7) const float HALO_MASS = 0.0;
+layout(constant_id = 8) const float HALO_SCALE = 1.0;
+layout(constant_id = 9) const float EXTERNAL_CENTER_X = 0.0;
+layout(constant_id = 10) const float EXTERNAL_CENTER_Y = 0.0;
+layout(constant_id = 11) const float EXTERNAL_CENTER_Z = 0.0;
+
+// Magnitude of the force between two particles `d_sqrt` apart, directed
+// along the line between them
+float pair_force(float d_sqrt, float mass1, float mass2) {
+    if (PAIR_LAW == PAIR_SOFTENED) {
+        float softened = d_sqrt * d_sqrt + SOFTENING * SOFTENING;
+        return (GRAVITY * mass1 * mass2) * d_sqrt / (softened * sqrt(softened));
+    }
+    if (PAIR_LAW == PAIR_YUKAWA) {
+        float x = d_sqrt / YUKAWA_LENGTH;
+        return (GRAVITY * mass1 * mass2) * (1.0 + x) * exp(-x) / (d_sqrt * d_sqrt);
+    }
+    return (GRAVITY * mass1 * mass2) / (d_sqrt * d_sqrt);
+}
+
+// Mass of the static halo within `r` of its centre
+float halo_enclosed_mass(float r) {
+    if (HALO_PROFILE == HALO_HERNQUIST) {
+        float ratio = r / (r + HALO_SCALE);
+        return HALO_MASS * ratio * ratio;
+    }
+    if (HALO_PROFILE == HALO_NFW) {
+        float x = r / HALO_SCALE;
+        return HALO_MASS * (log(1.0 + x) - x / (1.0 + x));
+    }
+    return 0.0;
+}
+
+// Acceleration from the fixed central mass and halo
+vec3 external_acceleration(vec3 position) {
+    if (CENTRAL_MASS == 0.0 && HALO_PROFILE == HALO_NONE) {
+        return vec3(0.0);
+    }
+
+    vec3 d_axis = vec3(EXTERNAL_CENTER_X, EXTERNAL_CENTER_Y, EXTERNAL_CENTER_Z) - position;
+    float r = length(d_axis);
+    if (r < MIN_INTERACTION_DISTANCE) {
+        return vec3(0.0);
+    }
+
+    float mass = CENTRAL_MASS + halo_enclosed_mass(r);
+    return d_axis / r * (GRAVITY * mass / (r * r));
+}
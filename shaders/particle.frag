@@ -0,0 +1,12 @@
+#version 440
+
+layout(location = 0) out vec4 out_color;
+
+void main() {
+    // Round sprite that fades towards its edge
+    vec2 offset = gl_PointCoord * 2.0 - 1.0;
+    float r2 = dot(offset, offset);
+    if (r2 > 1.0) discard;
+
+    out_color = vec4(1.0, 0.85, 0.6, 1.0) * (1.0 - r2);
+}
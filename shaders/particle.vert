@@ -0,0 +1,16 @@
+#version 440
+
+// Bound straight from the compute shader's storage buffer; one Particle per
+// vertex, of which only the position is read
+layout(location = 0) in vec3 in_position;
+
+layout(push_constant) uniform ViewBlock {
+    vec2 center;
+    float extent;
+    float point_size;
+} view;
+
+void main() {
+    gl_Position = vec4((in_position.xy - view.center) / view.extent, 0.5, 1.0);
+    gl_PointSize = view.point_size;
+}